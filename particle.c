@@ -1,364 +1,1546 @@
-/*
- * Genetic algorithm for 2D Lennard Jones particle simulation
- * M. Kuttel October 2020
- */                                                                                                                                             
-
-#include <string.h>
-#include <stdlib.h>
-#include <stdio.h>
-#include <math.h>
-#include <time.h>
-
-#define DEFAULT_POP_SIZE 300 //bigger population is more costly
-#define DEFAULT_NUM_PARTICLES 30 //more PARTICLES is more costly
-
-// consts
-static const int X_DEFAULT = 20; //width of box
-static const int Y_DEFAULT = 20; //length of box
-static const double MUTATION_RATE = 0.1; //how often random mutations occur
-static const double MAX_GEN = 1000; // maximum number of generations
-static const double ITERATIONS = 10; //number of times the whole process is run
-static const double TOLERANCE = 50; //not used... yet
-
-
-//each particle has x and y location in box
-typedef struct
-{
-    int x_pos;
-    int y_pos;
-} position;
-
-// box pattern
-typedef struct
-{
-    position *particle;
-    double fitness;
-} box_pattern;
-
-//display the box pattern
-void printbox(box_pattern box,int num_particles)
-{
-    int i;
-    for(i = 0; i < num_particles - 1; i++)
-    {
-        printf("%d,%d\t", box.particle[i].x_pos, box.particle[i].y_pos);
-    }
-    printf("%d,%d\t:fitness %f\n", box.particle[i].x_pos, box.particle[i].y_pos, box.fitness);
-}
-
-//print the box pattern to file
-void printboxFile(box_pattern box,FILE *f,int num_particles )
-{
-    int i;
-    for(i = 0; i < num_particles - 1; i++)
-    {
-        fprintf(f,"%d,%d\t", box.particle[i].x_pos, box.particle[i].y_pos);
-    }
-    fprintf(f,"%d,%d\n", box.particle[i].x_pos, box.particle[i].y_pos);
-}
-
-/* FITNESS FUNCTION  - this is key*/
-double calcFitness(box_pattern box,int num_particles)
-{
-    double fitness = 0.0;
-    int i,j;
-    double x,y,r,tmp;
-    for(i = 0; i < num_particles - 1; i++)
-    {
-        for(j = i + 1; j < num_particles; j++)
-        {   //cycle through all pairs to calc distances
-            x = (double)box.particle[i].x_pos - (double)box.particle[j].x_pos;
-            y = (double)box.particle[i].y_pos - (double)box.particle[j].y_pos;
-            r=sqrt((x*x)+(y*y));
-            tmp=2.0/r;
-            //fitness-= 1.0/r; // electric repulsion
-            //fitness-= pow(tmp,6); //purely repulsive function
-            if(r == 0)
-            {
-                fitness = 0;
-                break;
-            }
-            else
-                fitness+= (pow(tmp,12)-pow(tmp,6)); //Lennard-Jones function
-        }
-    }
-    return fitness;
-}
-
-/* Creates initial random population */
-void initPopulation(box_pattern * box, int population_size,int xmax,int ymax,int num_particles)
-{
-    int i,p;
-    for(p = 0; p < population_size; p++)
-    {
-        for(i=0; i<num_particles; i++)
-        {
-            box[p].particle[i].x_pos=(rand()%(xmax + 1));
-            box[p].particle[i].y_pos=(rand()%(ymax + 1));
-        }
-        box[p].fitness=calcFitness(box[p],num_particles);
-    }
-}
-
-/* create child from parents */
-box_pattern crossover(box_pattern child, box_pattern parentOne, box_pattern parentTwo, int splitPoint,int num_particles){
-    int i=0;
-    for(i=0; i<splitPoint; i++)
-    {   //copy over parentOne up to splitPoint
-        child.particle[i].x_pos=parentOne.particle[i].x_pos;
-        child.particle[i].y_pos=parentOne.particle[i].y_pos;
-    }
-    i--;
-    if((rand()%(2) == 1) && (i < num_particles) &&(i >= 0)) //50% of time split in middle of particle, more mixing
-        child.particle[i].y_pos=parentTwo.particle[i].y_pos;
-    
-    for(i = splitPoint; i < num_particles; i++)
-    {   //copy over parentTwo from splitPoint to end
-        child.particle[i].x_pos=parentTwo.particle[i].x_pos;
-        child.particle[i].y_pos=parentTwo.particle[i].y_pos;
-    }
-    child.fitness=calcFitness(child,num_particles); //calculate fitness
-    return child;
-}
-
-/* deep copy b into a [does a=b] */
-void copybox(box_pattern *a, box_pattern *b,int num_particles)
-{
-    int i;
-    for (i = 0; i < num_particles; i++){
-        (*a).particle[i].x_pos = (*b).particle[i].x_pos;
-        (*a).particle[i].y_pos = (*b).particle[i].y_pos;
-    }
-    (*a).fitness=(*b).fitness;
-}
-
-/* Main GA function - does selection, breeding, crossover and mutation */
-int breeding(box_pattern * box, int population_size, int x_max, int y_max,int num_particles)
-{
-        int highest;
-        box_pattern max_parent; //keep track of highest from previous generation
-        max_parent.particle = malloc(num_particles*sizeof(position));
-        copybox(&max_parent, &box[0], num_particles); //set max to first one
-        int i;
-        box_pattern * new_generation = (box_pattern*) malloc(sizeof(box_pattern)*(population_size));
-        for(i = 0; i < population_size; i++)
-            new_generation[i].particle = malloc(num_particles*sizeof(position));
-
-        for (i = 0; i < population_size; i += 2)
-        {   //two children
-            // Determine breeding pair, with tournament of 2 (joust)
-            int one, two, splitPoint, parentOne, parentTwo;
-            do
-            {
-                one = rand()%(population_size);
-                do
-                {
-                    two = rand()%(population_size);
-                } while(one == two);
-                parentOne = two;
-                if(box[one].fitness > box[two].fitness)
-                    parentOne = one; //joust
-                one = rand()%(population_size);
-                do
-                {
-                    two = rand()%(population_size);
-                } while(one == two);
-                parentTwo = two;
-                if(box[one].fitness > box[two].fitness)
-                    parentTwo = one; //joust
-            } while(parentOne == parentTwo);
-        
-            do
-            {
-                splitPoint = rand()%num_particles; //split chromosome at point
-            } while(splitPoint == 0 || splitPoint == num_particles - 1);
-            new_generation[i] = crossover(new_generation[i], box[parentOne], box[parentTwo], splitPoint, num_particles); //first child
-
-            new_generation[i+1] = crossover(new_generation[i+1], box[parentTwo], box[parentOne], splitPoint, num_particles); //second child
-        
-            // Mutation first child
-            double mutation = rand()/(double)RAND_MAX;
-            if(mutation <= MUTATION_RATE)
-            {
-                int mutated;
-                mutated = rand() % num_particles;
-                new_generation[i].particle[mutated].x_pos = (rand()%(x_max + 1));
-                new_generation[i].particle[mutated].y_pos = (rand()%(y_max + 1));
-                new_generation[i].fitness = calcFitness(new_generation[i], num_particles);
-            }
-            mutation = rand()/(double)RAND_MAX; //mutation second child
-            if(mutation <= MUTATION_RATE)
-            {
-                int mutated;
-                mutated = rand() % num_particles;
-                new_generation[i+1].particle[mutated].x_pos = (rand()%(x_max + 1));
-                new_generation[i+1].particle[mutated].y_pos = (rand()%(y_max + 1));
-                new_generation[i+1].fitness = calcFitness(new_generation[i+1], num_particles);
-            }
-        }
-  
-        //find maximum parent fitness to keep and minimum new generation to throw away
-        new_generation[0].fitness = calcFitness(new_generation[0],num_particles);
-        double min_fitness = new_generation[0].fitness;
-        int min_box = 0;
-        double max_fitness = new_generation[0].fitness;
-        highest = 0;
-        for(i = 1; i < population_size; i++)
-        {
-            if(box[i].fitness > max_parent.fitness)
-            {
-                copybox(&max_parent, &box[i], num_particles); //replace lowest fitness with highest parent
-            }
-            new_generation[i].fitness=calcFitness(new_generation[i],num_particles);
-            if(new_generation[i].fitness < min_fitness)
-            {
-                min_fitness = new_generation[i].fitness;
-                min_box = i;
-            }
-            if(new_generation[i].fitness > max_fitness)
-            {
-                max_fitness = new_generation[i].fitness;
-                highest = i;
-            }
-        }
-    
-        // printf("max fitness should be: %f\n",max_parent.fitness);
-        //copies
-        for(i = 0; i < population_size; i++)
-        {
-            //printbox(new_generation[i]);
-            if(i == min_box)
-            {
-                copybox(&box[i], &max_parent, num_particles);
-            } 
-            else
-            {
-                copybox(&box[i], &new_generation[i], num_particles);
-            }
-           // printbox(box[i]);
-        }
-        if(max_parent.fitness > max_fitness)
-        {   //previous generation has the best
-            max_fitness=max_parent.fitness;
-            highest=min_box;
-            //printf("max fitness should be: %f",max_parent.fitness);
-        }
-        for(i = 0;i < population_size; i++)
-            free(new_generation[i].particle); //release memory
-        free(new_generation); //release memory
-        free(max_parent.particle);
-        return highest;
-}
-
-
-int main(int argc, char *argv[])
-{
-    int population_size = DEFAULT_POP_SIZE;
-    int x_max = X_DEFAULT;
-    int y_max = Y_DEFAULT;
-    int num_particles = DEFAULT_NUM_PARTICLES;
-    int iter = ITERATIONS;
-    int k,i;
-    if(argc >= 2)
-    {
-        population_size = atoi(argv[1]); //size population first command line argument
-        if(argc >= 4)
-        {
-            x_max = atoi(argv[2]); //x dimension
-            y_max = atoi(argv[3]); //x dimension
-        }
-        if(argc >= 5)
-            num_particles = atoi(argv[4]);
-        if(argc == 6)
-            iter = atoi(argv[5]);
-    }
-
-    printf("Starting optimization with particles = %d, population=%d, width=%d,length=%d for %d iterations\n", num_particles, population_size, x_max, y_max, iter);
-
-    int gen_count = 0;
-    double total_fitness = 0;
-    double total_time = 0;
-
-    char file_name[100];
-    sprintf(file_name, "solution_%d_%d_%d_%d_%d.txt", population_size, x_max, y_max, num_particles, iter);
-    FILE *f = fopen(file_name, "w");
-    FILE *results = fopen("results.txt","a");
-    fprintf(results, "%s_%d_%d_%d_%d_%d\n", argv[0], population_size, x_max, y_max, num_particles, iter);
-    printf("Writing dimensions to file\n");
-    fprintf(f, "%d,%d\n", x_max, y_max); //write box dimensions as first line of file
-    box_pattern * population;
-
-    population = (box_pattern*) malloc(sizeof(box_pattern)*population_size); //allocate memory
-    for(i=0;i<population_size;i++)
-        population[i].particle = malloc(num_particles*sizeof(position));//allocate memory
-
-    for(k=0; k<iter; k++)
-    {   //k is number of times whole simulation is run
-        // populate with initial population
-        printf("initializing population\n");
-        initPopulation(population, population_size, x_max, y_max, num_particles);
-        printf("=========%d\n", k);
-
-        double max_fitness = 0;
-        // main loop
-        int stop = 0;
-        int gen = 0,highest = 0;
-        int current_tolerance = 0;
-        int max_tolerance = MAX_GEN/5;
-
-        clock_t begin = clock();
-
-        while(gen < MAX_GEN)
-        {
-            if(current_tolerance >= max_tolerance)
-            {
-                printf("No new improvements after %d generations. Stopping.\n", max_tolerance);
-                break;
-            }
-
-            int current_best = breeding(population, population_size, x_max, y_max, num_particles);
-            if(current_best > highest)
-            {
-                highest = current_best;
-                current_tolerance = 0;
-            }
-            else
-                current_tolerance += 1;
-            
-            gen += 1;
-        }
-
-        clock_t end = clock();
-        
-        double time_spent = (double)(end - begin)/CLOCKS_PER_SEC;
-        total_time += time_spent;
-
-        printf("# generations= %d \n", gen);
-        printf("Best solution:\n");
-        printbox(population[highest], num_particles);
-        if (f == NULL)
-        {
-            printf("Error opening file!\n");
-            exit(1);
-        }
-        printboxFile(population[highest], f, num_particles);
-        printf("Time taken: %f\n", time_spent);
-        printf("---------\n");
-        fprintf(results, "%f\n", (double)population[highest].fitness);
-        total_fitness += (double)population[highest].fitness;
-        gen_count += gen;
-    }
-    
-
-    for(i = 0; i < population_size; i++)
-        free(population[i].particle); //release memory
-    free(population); //release memory
-    fprintf(results, "Average fitness: %f\n", (double)total_fitness/(double)k);
-    fprintf(results, "Average generations: %f\n", (double)gen_count/(double)k);
-    fprintf(results, "Average time spent per iteration: %f\n", (double)total_time/(double)k);
-    fprintf(results, "---------\n");
-    fclose(f);
-    fclose(results);
-    return 0;
-}
-
+/*
+ * Genetic algorithm for 2D Lennard Jones particle simulation
+ * M. Kuttel October 2020
+ */                                                                                                                                             
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <limits.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS //vector fitness kernels, chosen at run time
+#endif
+
+#define DEFAULT_POP_SIZE 300 //bigger population is more costly
+#define DEFAULT_NUM_PARTICLES 30 //more PARTICLES is more costly
+
+// consts
+static const int X_DEFAULT = 20; //width of box
+static const int Y_DEFAULT = 20; //length of box
+static const double MUTATION_RATE = 0.1; //how often random mutations occur
+static const double MAX_GEN = 1000; // maximum number of generations
+static const double ITERATIONS = 10; //number of times the whole process is run
+static const double TOLERANCE = 50; //generations without improvement before a run stops, see --patience
+
+#define KERNEL_CHECKS 64 //random boxes used to validate a vector fitness kernel
+#define KERNEL_TOLERANCE 1e-9 //relative difference from the scalar kernel allowed
+
+
+// genome coordinate type, chosen at build time with -DCOORD_BITS=8, 16 or 32 and checked against the box in main
+// narrower coordinates put more boxes in each cache line and shrink migration messages
+#ifndef COORD_BITS
+#define COORD_BITS 16
+#endif
+#if COORD_BITS == 8
+typedef uint8_t coord_t;
+#define COORD_MAX UINT8_MAX
+#elif COORD_BITS == 16
+typedef int16_t coord_t;
+#define COORD_MAX INT16_MAX
+#elif COORD_BITS == 32
+typedef int32_t coord_t;
+#define COORD_MAX INT32_MAX
+#else
+#error "COORD_BITS must be 8, 16 or 32"
+#endif
+
+// population of box patterns, stored as a structure of arrays in one aligned arena
+// particle i of box b is at (x[b*num_particles + i], y[b*num_particles + i])
+typedef struct
+{
+    coord_t *x;
+    coord_t *y;
+    double *fitness;
+    int *overlap; //set when two particles of a box share a grid point
+    int size; //number of boxes
+    int num_particles;
+    char *arena; //single allocation holding all of the above
+} box_population;
+
+#define ARENA_ALIGN 64 //cache line size in bytes
+
+//coordinates of box b in a population
+#define BOX_X(pop,b) ((pop)->x + (size_t)(b)*(pop)->num_particles)
+#define BOX_Y(pop,b) ((pop)->y + (size_t)(b)*(pop)->num_particles)
+
+// Lennard-Jones energy indexed by squared particle distance, built by initEnergyTable
+static double *lj_table;
+
+// number of boxes run through a fitness kernel, to report evaluations per generation, cache hits are not included
+static long fitness_evals = 0;
+
+// fitness memo, a direct-mapped table from the hash of a box's coordinates to its fitness
+// converged populations are full of clones, which then skip the O(N^2) kernel, see evalPopulation
+// only the 64-bit hash is kept, not the genome, so two boxes whose hashes collide would share a fitness
+// that is accepted, a lookup compares one stored hash, so the odds are 1 in 2^64 per evaluation
+typedef struct
+{
+    uint64_t hash; //0 marks an empty entry
+    double fitness;
+    int overlap;
+} cache_entry;
+
+#define DEFAULT_CACHE_SIZE 16384 //entries, a power of two
+static cache_entry *fitness_cache;
+static size_t cache_mask; //entries - 1, the cache is off when there are none
+static long cache_hits = 0; //boxes answered by the cache instead of a kernel
+
+// pair energy kernel for one box, see selectKernel
+typedef double (*fitness_function)(const coord_t *x, const coord_t *y, int num_particles, int *overlap);
+static fitness_function fitness_kernel;
+static const char *kernel_name;
+
+// cell list of the cutoff kernel, see calcFitnessCells, a single one
+typedef struct
+{
+    int *head; //first particle in each cell, -1 when empty
+    int *next; //next particle in the same cell
+    double *row; //energy of particle i with the particles after it within the cutoff
+    int *row_hit; //set when particle i sits on a particle after it
+} cell_list;
+
+static cell_list *cells;
+static int num_cells; //cell lists allocated
+static int cell_size, cells_x, cells_y; //side of a cell in grid units, cells across and down the box
+static int cutoff_d2 = INT_MAX; //squared cutoff radius, pairs further apart are left out
+
+// hot path phases, timed by the phase timer and written to the timing file after every iteration
+// the breeding phases, up to PHASE_OTHER, are only timed on sampled generations as reading the clock
+// is not free next to a small fitness evaluation, their counts are exact
+enum {PHASE_SELECTION, PHASE_CROSSOVER, PHASE_MUTATION, PHASE_LOCAL, PHASE_FITNESS, PHASE_ELITISM, PHASE_OTHER, NUM_PHASES};
+static const char *phase_names[NUM_PHASES] = {"selection", "crossover", "mutation", "local", "fitness", "elitism", "other"};
+
+// wall time spent in and number of entries to each phase
+// fitness evaluations are charged to the fitness phase, not to the phase that asked for them
+typedef struct
+{
+    double time[NUM_PHASES];
+    long count[NUM_PHASES];
+    double start; //when the running phase was entered or last charged
+    int phase; //running phase
+    int sampled; //set while a sampled generation is being timed
+    int generations; //generations bred and how many of them were sampled
+    int samples;
+} phase_timer;
+
+#define TIMING_SAMPLE 8 //one generation in this many has its breeding phases timed
+static phase_timer timer;
+
+// best fitness so far and the generation that last improved it, see updateMonitor
+typedef struct
+{
+    double best;
+    int best_gen;
+    FILE *log; //improvements are appended as run,iteration,generation,fitness rows, or NULL
+    const char *run;
+    int iteration;
+} convergence_monitor;
+
+// xoshiro256** generator state, unlike rand() it can be saved in a checkpoint and restored
+typedef struct
+{
+    uint64_t s[4];
+} rng_state;
+
+static rng_state rng; //the only stream, see initRng
+
+// where a run had got to when a checkpoint was taken, see saveCheckpoint
+// checkpoints are raw memory images, read back only by the same build on the same kind of machine
+typedef struct
+{
+    char magic[8]; //CHECKPOINT_MAGIC
+    int coord_bits; //the build and problem the checkpoint belongs to
+    int population_size, x_max, y_max, num_particles, iter;
+    int num_streams; //generator states that follow the header
+    int iteration; //progress of the current iteration
+    int generation; //0 when iteration has not started yet
+    int highest;
+    double best; //convergence monitor
+    int best_gen;
+    long fitness_evals;
+    long cache_hits;
+    double elapsed; //wall time of the iteration so far
+    int gen_count; //totals of the finished iterations
+    long eval_count;
+    long hit_count;
+    double total_fitness;
+    double total_time;
+} checkpoint_header;
+
+#define CHECKPOINT_MAGIC "GACKPT1" //changes with the layout
+
+// the latest snapshot, written out by a background thread so that breeding never waits for the disk
+typedef struct
+{
+    checkpoint_header header; //filled in by main, completed by saveCheckpoint
+    double begin; //wall time the iteration started
+    const char *name;
+    char *buffer; //header, generator and population, packed
+    size_t bytes;
+    pthread_t writer;
+    int writing; //set until the writer has been joined
+} checkpoint_state;
+
+static checkpoint_state checkpoint;
+
+// command line options given as --name=value, see parseOptions
+static const char *kernel_option = "auto"; //--kernel=auto|scalar|avx2|avx512
+static int patience_option; //--patience=N, generations without improvement before stopping, TOLERANCE by default
+static double min_improvement_option = 0; //--min-improvement=X, smallest absolute fitness gain that counts
+static double min_rel_improvement_option = 0; //--min-rel-improvement=X, smallest gain relative to the best so far
+static int local_moves_option = 0; //--local-moves=N, local search moves tried on every child, 0 turns it off
+static int cache_option = DEFAULT_CACHE_SIZE; //--cache=N, entries of the fitness cache, 0 turns it off
+static double cutoff_option = 0; //--cutoff=R, pair energies beyond radius R are left out, 0 sums all pairs
+static uint64_t seed_option = 1; //--seed=N, every random number derives from it
+static int checkpoint_option = 0; //--checkpoint=N, save the run every N generations, 0 turns it off
+static int resume_option = 0; //--resume, carry on from the last checkpoint if there is one
+static int steady_state_option = 0; //--steady-state, replace tournament losers in place instead of breeding generations
+
+/* wall clock time in seconds */
+double wallTime(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + 1e-9*now.tv_nsec;
+}
+
+/* charge the time since the last switch to the running phase and make p the running phase */
+void chargePhase(phase_timer *t, int p)
+{
+    if((*t).sampled)
+    {
+        double now = wallTime();
+        (*t).time[(*t).phase] += now - (*t).start;
+        (*t).start = now;
+    }
+    (*t).phase = p;
+}
+
+/* enter phase p, counting the entry */
+void enterPhase(phase_timer *t, int p)
+{
+    chargePhase(t, p);
+    (*t).count[p]++;
+}
+
+/* clear a timer at the start of an iteration */
+void resetTimer(phase_timer *t)
+{
+    memset(t, 0, sizeof(*t));
+    (*t).phase = PHASE_OTHER;
+}
+
+/* start breeding a generation, timing it if it is a sampled one */
+void beginGeneration(phase_timer *t)
+{
+    (*t).sampled = ((*t).generations++ % TIMING_SAMPLE == 0);
+    (*t).phase = PHASE_OTHER;
+    if((*t).sampled)
+    {
+        (*t).samples++;
+        (*t).start = wallTime();
+    }
+}
+
+/* finish breeding a generation */
+void endGeneration(phase_timer *t)
+{
+    chargePhase(t, PHASE_OTHER);
+    (*t).sampled = 0;
+}
+
+/* estimated time of phase p over all generations, scaled up from the sampled ones */
+double phaseTime(phase_timer *t, int p)
+{
+    if((*t).samples == 0)
+        return (*t).time[p];
+    return (*t).time[p]*(*t).generations/(*t).samples;
+}
+
+/* open the timing file for appending, with a header line if it is new
+ * rows are run,iteration,phase,count,mean_seconds,max_seconds, the columns of the parallel programs
+ * there is a single thread here, so max_seconds is always the same as mean_seconds */
+FILE *openTiming(const char *file_name)
+{
+    FILE *timing = fopen(file_name, "a");
+    if(timing == NULL)
+    {
+        printf("Error opening file!\n");
+        exit(1);
+    }
+    fseek(timing, 0, SEEK_END);
+    if(ftell(timing) == 0)
+        fprintf(timing, "run,iteration,phase,count,mean_seconds,max_seconds\n");
+    return timing;
+}
+
+/* append the phase breakdown of one iteration to the timing file, closed by its total wall time */
+void writeTiming(FILE *timing, const char *run, int iteration, int generations, double time_spent)
+{
+    int p;
+    for(p = 0; p < NUM_PHASES; p++)
+    {
+        double seconds = phaseTime(&timer, p);
+        fprintf(timing, "%s,%d,%s,%ld,%f,%f\n", run, iteration, phase_names[p], timer.count[p], seconds, seconds); //mean and max of one thread
+    }
+    fprintf(timing, "%s,%d,total,%d,%f,%f\n", run, iteration, generations, time_spent, time_spent);
+}
+
+/* open the convergence log for appending, with a header line if it is new */
+FILE *openConvergence(const char *file_name)
+{
+    FILE *log = fopen(file_name, "a");
+    if(log == NULL)
+    {
+        printf("Error opening file!\n");
+        exit(1);
+    }
+    fseek(log, 0, SEEK_END);
+    if(ftell(log) == 0)
+        fprintf(log, "run,iteration,generation,fitness\n");
+    return log;
+}
+
+/* start tracking the best fitness of a new iteration, improvements go to log unless it is NULL */
+void startMonitor(convergence_monitor *m, FILE *log, const char *run, int iteration)
+{
+    (*m).best = -INFINITY;
+    (*m).best_gen = 0;
+    (*m).log = log;
+    (*m).run = run;
+    (*m).iteration = iteration;
+}
+
+/* record the best fitness of generation gen
+ * returns 1 if it beats the best so far by more than both the absolute and the relative threshold */
+int updateMonitor(convergence_monitor *m, int gen, double fitness)
+{
+    double gain = fitness - (*m).best;
+    if((*m).best != -INFINITY && (gain <= min_improvement_option || gain <= min_rel_improvement_option*fabs((*m).best)))
+        return 0;
+    (*m).best = fitness;
+    (*m).best_gen = gen;
+    if((*m).log != NULL)
+        fprintf((*m).log, "%s,%d,%d,%f\n", (*m).run, (*m).iteration, gen, fitness);
+    return 1;
+}
+
+/* set once patience_option generations have gone by without an improvement */
+int converged(convergence_monitor *m, int gen)
+{
+    return gen - (*m).best_gen >= patience_option;
+}
+
+/* round a size in bytes up to a whole number of cache lines */
+size_t alignArena(size_t bytes)
+{
+    return (bytes + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+/* allocate a population of boxes as one contiguous, aligned arena */
+void allocPopulation(box_population *pop, int size, int num_particles)
+{
+    //the regions after the coordinates let the vector kernels load a full register past the last particle
+    size_t coords = alignArena((size_t)size*num_particles*sizeof(coord_t));
+    size_t fitness = alignArena((size_t)size*sizeof(double));
+    size_t overlap = alignArena((size_t)size*sizeof(int));
+    (*pop).arena = aligned_alloc(ARENA_ALIGN, 2*coords + fitness + overlap);
+    if((*pop).arena == NULL)
+    {
+        printf("Error allocating population!\n");
+        exit(1);
+    }
+    (*pop).x = (coord_t*)(*pop).arena;
+    (*pop).y = (coord_t*)((*pop).arena + coords);
+    (*pop).fitness = (double*)((*pop).arena + 2*coords);
+    (*pop).overlap = (int*)((*pop).arena + 2*coords + fitness);
+    (*pop).size = size;
+    (*pop).num_particles = num_particles;
+}
+
+/* release the arena of a population */
+void freePopulation(box_population *pop)
+{
+    free((*pop).arena);
+    (*pop).arena = NULL;
+}
+
+//display the box pattern
+void printbox(box_population *pop, int b)
+{
+    int i;
+    const coord_t *x = BOX_X(pop,b);
+    const coord_t *y = BOX_Y(pop,b);
+    for(i = 0; i < (*pop).num_particles - 1; i++)
+    {
+        printf("%d,%d\t", x[i], y[i]);
+    }
+    printf("%d,%d\t:fitness %f\n", x[i], y[i], (*pop).fitness[b]);
+}
+
+//print the box pattern to file
+void printboxFile(box_population *pop, int b, FILE *f)
+{
+    int i;
+    const coord_t *x = BOX_X(pop,b);
+    const coord_t *y = BOX_Y(pop,b);
+    for(i = 0; i < (*pop).num_particles - 1; i++)
+    {
+        fprintf(f,"%d,%d\t", x[i], y[i]);
+    }
+    fprintf(f,"%d,%d\n", x[i], y[i]);
+}
+
+/* precompute Lennard-Jones energy for every squared distance that fits in the box */
+void initEnergyTable(int x_max, int y_max)
+{
+    int d2;
+    long long max_d2 = (long long)x_max*x_max + (long long)y_max*y_max; //particles lie in [0,x_max]x[0,y_max]
+    double r,tmp;
+    if(max_d2 >= INT_MAX) //the kernels index the table with int squared distances
+    {
+        printf("A %dx%d box is too big for the energy table, its squared diagonal has to fit an int\n", x_max, y_max);
+        exit(1);
+    }
+    lj_table = malloc(((size_t)max_d2 + 1)*sizeof(double)); //grows with the box area, 17 GB for 32767x32767
+    if(lj_table == NULL)
+    {
+        printf("Error allocating the energy table of a %dx%d box!\n", x_max, y_max);
+        exit(1);
+    }
+    lj_table[0] = 0; //coincident particles are handled in calcFitness
+    for(d2 = 1; d2 <= max_d2; d2++)
+    {
+        r=sqrt((double)d2);
+        tmp=2.0/r;
+        //lj_table[d2]= -1.0/r; // electric repulsion
+        //lj_table[d2]= -pow(tmp,6); //purely repulsive function
+        lj_table[d2]= (pow(tmp,12)-pow(tmp,6)); //Lennard-Jones function
+    }
+}
+
+/* FITNESS FUNCTION  - this is key
+ * plain C version of the pair kernel, the reference for the vector kernels */
+double calcFitnessScalar(const coord_t *x, const coord_t *y, int num_particles, int *overlap)
+{
+    double fitness = 0.0;
+    int i,j;
+    int dx,dy,d2;
+    *overlap = 0;
+    for(i = 0; i < num_particles - 1; i++)
+    {
+        for(j = i + 1; j < num_particles; j++)
+        {   //cycle through all pairs to calc distances
+            dx = x[i] - x[j];
+            dy = y[i] - y[j];
+            d2=(dx*dx)+(dy*dy); //squared distance is an integer, so look up the energy
+            if(d2 == 0)
+            {
+                fitness = 0;
+                *overlap = 1;
+                break;
+            }
+            else
+                fitness+= lj_table[d2]; //Lennard-Jones function
+        }
+    }
+    return fitness;
+}
+
+#ifdef HAVE_X86_KERNELS
+// coordinates j..j+7 or j..j+15 widened to 32-bit lanes, the narrow types are loaded whole and the
+// lanes past the last particle are masked off afterwards, the arena always has room for the full load
+#if COORD_BITS == 8
+#define LOAD8_COORDS(p,lanes) _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(p)))
+#define LOAD16_COORDS(p,lanes) _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)(p)))
+#elif COORD_BITS == 16
+#define LOAD8_COORDS(p,lanes) _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(p)))
+#define LOAD16_COORDS(p,lanes) _mm512_cvtepi16_epi32(_mm256_loadu_si256((const __m256i*)(p)))
+#else
+#define LOAD8_COORDS(p,lanes) _mm256_maskload_epi32((const int*)(p), lanes)
+#define LOAD16_COORDS(p,lanes) _mm512_maskz_loadu_epi32(lanes, p)
+#endif
+
+// sliding window of lane masks, load from tail_mask + 8 - n to enable the first n lanes
+static const int tail_mask[16] = {-1, -1, -1, -1, -1, -1, -1, -1, 0, 0, 0, 0, 0, 0, 0, 0};
+
+/* AVX2 pair kernel - particle i against 8 partners at a time
+ * a coincident pair anywhere in row i zeroes the fitness, exactly as the scalar break does */
+__attribute__((target("avx2")))
+double calcFitnessAVX2(const coord_t *x, const coord_t *y, int num_particles, int *overlap)
+{
+    double fitness = 0.0;
+    int i,j;
+    const __m256i zero = _mm256_setzero_si256();
+    *overlap = 0;
+    for(i = 0; i < num_particles - 1; i++)
+    {
+        __m256i xi = _mm256_set1_epi32(x[i]);
+        __m256i yi = _mm256_set1_epi32(y[i]);
+        __m256i hits = zero;
+        __m256d sum = _mm256_setzero_pd();
+        for(j = i + 1; j < num_particles; j += 8)
+        {
+            int left = num_particles - j;
+            __m256i lanes = _mm256_loadu_si256((const __m256i*)(tail_mask + 8 - (left < 8 ? left : 8)));
+            __m256i dx = _mm256_sub_epi32(xi, LOAD8_COORDS(x + j, lanes));
+            __m256i dy = _mm256_sub_epi32(yi, LOAD8_COORDS(y + j, lanes));
+            __m256i d2 = _mm256_add_epi32(_mm256_mullo_epi32(dx, dx), _mm256_mullo_epi32(dy, dy));
+            hits = _mm256_or_si256(hits, _mm256_and_si256(lanes, _mm256_cmpeq_epi32(d2, zero)));
+            //gather energies, 4 doubles per gather, skipping lanes past the last particle
+            __m256d lo_lanes = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm256_castsi256_si128(lanes)));
+            __m256d hi_lanes = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm256_extracti128_si256(lanes, 1)));
+            sum = _mm256_add_pd(sum, _mm256_mask_i32gather_pd(_mm256_setzero_pd(), lj_table, _mm256_castsi256_si128(d2), lo_lanes, 8));
+            sum = _mm256_add_pd(sum, _mm256_mask_i32gather_pd(_mm256_setzero_pd(), lj_table, _mm256_extracti128_si256(d2, 1), hi_lanes, 8));
+        }
+        if(!_mm256_testz_si256(hits, hits))
+        {
+            fitness = 0;
+            *overlap = 1;
+        }
+        else
+        {
+            __m128d pair = _mm_add_pd(_mm256_castpd256_pd128(sum), _mm256_extractf128_pd(sum, 1));
+            fitness += _mm_cvtsd_f64(_mm_add_sd(pair, _mm_unpackhi_pd(pair, pair)));
+        }
+    }
+    return fitness;
+}
+
+/* AVX-512 pair kernel - particle i against 16 partners at a time, tail handled with lane masks */
+__attribute__((target("avx512f")))
+double calcFitnessAVX512(const coord_t *x, const coord_t *y, int num_particles, int *overlap)
+{
+    double fitness = 0.0;
+    int i,j;
+    const __m512i zero = _mm512_setzero_si512();
+    *overlap = 0;
+    for(i = 0; i < num_particles - 1; i++)
+    {
+        __m512i xi = _mm512_set1_epi32(x[i]);
+        __m512i yi = _mm512_set1_epi32(y[i]);
+        __mmask16 hits = 0;
+        __m512d sum = _mm512_setzero_pd();
+        for(j = i + 1; j < num_particles; j += 16)
+        {
+            int left = num_particles - j;
+            __mmask16 lanes = left < 16 ? (__mmask16)((1u << left) - 1) : (__mmask16)0xFFFF;
+            __m512i dx = _mm512_sub_epi32(xi, LOAD16_COORDS(x + j, lanes));
+            __m512i dy = _mm512_sub_epi32(yi, LOAD16_COORDS(y + j, lanes));
+            __m512i d2 = _mm512_add_epi32(_mm512_mullo_epi32(dx, dx), _mm512_mullo_epi32(dy, dy));
+            hits |= _mm512_mask_cmpeq_epi32_mask(lanes, d2, zero);
+            sum = _mm512_add_pd(sum, _mm512_mask_i32gather_pd(_mm512_setzero_pd(), (__mmask8)lanes, _mm512_castsi512_si256(d2), lj_table, 8));
+            sum = _mm512_add_pd(sum, _mm512_mask_i32gather_pd(_mm512_setzero_pd(), (__mmask8)(lanes >> 8), _mm512_extracti64x4_epi64(d2, 1), lj_table, 8));
+        }
+        if(hits)
+        {
+            fitness = 0;
+            *overlap = 1;
+        }
+        else
+            fitness += _mm512_reduce_add_pd(sum);
+    }
+    return fitness;
+}
+#endif
+
+/* O(N) cutoff kernel - bins the particles into cells of cutoff size and pairs each particle only with
+ * those in its own and the 8 neighbouring cells, leaving out pairs beyond the cutoff radius
+ * the energies are summed per row and the rows folded in order, so an overlap zeroes the fitness
+ * exactly as in the all-pairs kernels */
+double calcFitnessCells(const coord_t *x, const coord_t *y, int num_particles, int *overlap)
+{
+    cell_list *c = &cells[0];
+    double fitness = 0.0;
+    int i,j,cx,cy,nx,ny;
+    int dx,dy,d2;
+    for(i = 0; i < cells_x*cells_y; i++)
+        (*c).head[i] = -1;
+    for(i = num_particles - 1; i >= 0; i--)
+    {
+        int cell = (y[i]/cell_size)*cells_x + x[i]/cell_size;
+        (*c).next[i] = (*c).head[cell];
+        (*c).head[cell] = i;
+        (*c).row[i] = 0.0;
+        (*c).row_hit[i] = 0;
+    }
+    for(i = 0; i < num_particles; i++)
+    {
+        cx = x[i]/cell_size;
+        cy = y[i]/cell_size;
+        for(ny = (cy > 0 ? cy - 1 : 0); ny <= cy + 1 && ny < cells_y; ny++)
+        {
+            for(nx = (cx > 0 ? cx - 1 : 0); nx <= cx + 1 && nx < cells_x; nx++)
+            {
+                for(j = (*c).head[ny*cells_x + nx]; j >= 0; j = (*c).next[j])
+                {
+                    if(j <= i)
+                        continue; //every pair once, in the row of its first particle
+                    dx = x[i] - x[j];
+                    dy = y[i] - y[j];
+                    d2 = (dx*dx)+(dy*dy);
+                    if(d2 == 0)
+                        (*c).row_hit[i] = 1;
+                    else if(d2 <= cutoff_d2)
+                        (*c).row[i] += lj_table[d2];
+                }
+            }
+        }
+    }
+    *overlap = 0;
+    for(i = 0; i < num_particles - 1; i++)
+    {
+        if((*c).row_hit[i])
+        {
+            fitness = 0;
+            *overlap = 1;
+        }
+        else
+            fitness += (*c).row[i];
+    }
+    return fitness;
+}
+
+/* switch to the cutoff kernel with the given radius, for boxes of num_particles particles */
+void initCells(double cutoff, int x_max, int y_max, int num_particles)
+{
+    int i;
+    cutoff = fmin(cutoff, hypot(x_max, y_max)); //no pair is further apart, and the squared diagonal fits an int
+    cell_size = (int)ceil(cutoff);
+    cutoff_d2 = (int)(cutoff*cutoff);
+    cells_x = x_max/cell_size + 1;
+    cells_y = y_max/cell_size + 1;
+    num_cells = 1;
+    cells = malloc(num_cells*sizeof(cell_list));
+    for(i = 0; i < num_cells; i++)
+    {
+        cells[i].head = malloc(cells_x*cells_y*sizeof(int));
+        cells[i].next = malloc(num_particles*sizeof(int));
+        cells[i].row = malloc(num_particles*sizeof(double));
+        cells[i].row_hit = malloc(num_particles*sizeof(int));
+    }
+    fitness_kernel = calcFitnessCells;
+    kernel_name = "cells";
+}
+
+/* release the cell lists */
+void freeCells(void)
+{
+    int i;
+    for(i = 0; i < num_cells; i++)
+    {
+        free(cells[i].head);
+        free(cells[i].next);
+        free(cells[i].row);
+        free(cells[i].row_hit);
+    }
+    free(cells);
+}
+
+/* print how far the cutoff fitness of box b is from the exact all-pairs sum */
+void reportCutoffError(box_population *pop, int b)
+{
+    int overlap;
+    double exact = calcFitnessScalar(BOX_X(pop,b), BOX_Y(pop,b), (*pop).num_particles, &overlap);
+    double error = (*pop).fitness[b] - exact;
+    printf("Cutoff energy error of the best box: %f (%g relative)\n", error, error/fmax(1.0, fabs(exact)));
+}
+
+/* pick the fitness kernel named by --kernel, "auto" takes the widest the CPU supports */
+void selectKernel(const char *name)
+{
+    fitness_kernel = calcFitnessScalar;
+    kernel_name = "scalar";
+#ifdef HAVE_X86_KERNELS
+    __builtin_cpu_init();
+    if((strcmp(name, "auto") == 0 || strcmp(name, "avx512") == 0) && __builtin_cpu_supports("avx512f"))
+    {
+        fitness_kernel = calcFitnessAVX512;
+        kernel_name = "avx512";
+    }
+    else if((strcmp(name, "auto") == 0 || strcmp(name, "avx2") == 0) && __builtin_cpu_supports("avx2"))
+    {
+        fitness_kernel = calcFitnessAVX2;
+        kernel_name = "avx2";
+    }
+#endif
+    if(strcmp(name, "auto") != 0 && strcmp(name, kernel_name) != 0)
+        printf("Fitness kernel %s is not available, using %s\n", name, kernel_name);
+}
+
+/* validate the selected kernel against the scalar one on random boxes,
+ * falls back to the scalar kernel if they disagree */
+void checkKernel(int x_max, int y_max, int num_particles)
+{
+    int b,i;
+    int overlap, ref_overlap;
+    double fitness, ref_fitness;
+    unsigned int seed = 12345; //private generator, so the GA's random stream is untouched
+    coord_t *x,*y;
+    if(fitness_kernel == calcFitnessScalar)
+        return;
+    x = malloc((num_particles + 16)*sizeof(coord_t)); //room for a full register past the last particle
+    y = malloc((num_particles + 16)*sizeof(coord_t));
+    for(b = 0; b < KERNEL_CHECKS; b++)
+    {
+        for(i = 0; i < num_particles; i++)
+        {
+            seed = seed*1103515245 + 12345;
+            x[i] = (seed >> 16)%(x_max + 1);
+            seed = seed*1103515245 + 12345;
+            y[i] = (seed >> 16)%(y_max + 1);
+        }
+        ref_fitness = calcFitnessScalar(x, y, num_particles, &ref_overlap);
+        fitness = fitness_kernel(x, y, num_particles, &overlap);
+        if(overlap != ref_overlap || fabs(fitness - ref_fitness) > KERNEL_TOLERANCE*fmax(1.0, fabs(ref_fitness)))
+        {
+            printf("Fitness kernel %s disagrees with scalar (%f vs %f), using scalar\n", kernel_name, fitness, ref_fitness);
+            fitness_kernel = calcFitnessScalar;
+            kernel_name = "scalar";
+            break;
+        }
+    }
+    free(x);
+    free(y);
+}
+
+/* allocate an empty fitness cache of at least entries entries, rounded up to a power of two
+ * no entries turns the cache off */
+void initCache(size_t entries)
+{
+    size_t size = 1;
+    cache_mask = 0;
+    if(entries == 0)
+        return;
+    while(size < entries)
+        size *= 2;
+    fitness_cache = calloc(size, sizeof(cache_entry));
+    if(fitness_cache == NULL)
+    {
+        printf("Error allocating fitness cache!\n");
+        exit(1);
+    }
+    cache_mask = size - 1;
+}
+
+/* release the fitness cache */
+void freeCache(void)
+{
+    free(fitness_cache);
+}
+
+/* 64-bit FNV-1a hash of the coordinates of a box, a coordinate widened to 32 bits at a time, never 0 */
+uint64_t hashBox(const coord_t *x, const coord_t *y, int num_particles)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    int i;
+    for(i = 0; i < num_particles; i++)
+        hash = (hash ^ (uint32_t)x[i])*1099511628211ULL;
+    for(i = 0; i < num_particles; i++)
+        hash = (hash ^ (uint32_t)y[i])*1099511628211ULL;
+    return hash ? hash : 1;
+}
+
+/* fitness and overlap flag of the box with this hash, returns 1 if the cache holds it */
+int cacheLookup(uint64_t hash, double *fitness, int *overlap)
+{
+    size_t i = hash & cache_mask;
+    int hit;
+    hit = fitness_cache[i].hash == hash;
+    if(hit)
+    {
+        *fitness = fitness_cache[i].fitness;
+        *overlap = fitness_cache[i].overlap;
+    }
+    return hit;
+}
+
+/* remember the fitness of the box with this hash, evicting whatever shared its entry */
+void cacheStore(uint64_t hash, double fitness, int overlap)
+{
+    size_t i = hash & cache_mask;
+    fitness_cache[i].hash = hash;
+    fitness_cache[i].fitness = fitness;
+    fitness_cache[i].overlap = overlap;
+}
+
+/* evaluate boxes start..start+count-1 of a population with the selected kernel, or from the fitness cache
+ * where it has seen a box, storing their fitness and overlap flags
+ * the one place fitness is computed, so the phase timer and the counters are updated once per batch */
+void evalPopulation(box_population *pop, int start, int count)
+{
+    int resume = timer.phase;
+    int num_particles = (*pop).num_particles;
+    long hits = 0;
+    int b;
+    enterPhase(&timer, PHASE_FITNESS);
+    for(b = start; b < start + count; b++)
+    {
+        const coord_t *x = BOX_X(pop,b);
+        const coord_t *y = BOX_Y(pop,b);
+        int *overlap = &(*pop).overlap[b];
+        if(cache_mask == 0)
+            (*pop).fitness[b] = fitness_kernel(x, y, num_particles, overlap);
+        else
+        {   //clones hash the same, only the first of them runs the kernel
+            uint64_t hash = hashBox(x, y, num_particles);
+            if(cacheLookup(hash, &(*pop).fitness[b], overlap))
+                hits++;
+            else
+            {
+                (*pop).fitness[b] = fitness_kernel(x, y, num_particles, overlap);
+                cacheStore(hash, (*pop).fitness[b], *overlap);
+            }
+        }
+    }
+    fitness_evals += count - hits;
+    cache_hits += hits;
+    chargePhase(&timer, resume);
+}
+
+/* energy between particle p placed at (px,py) and all other particles - O(N)
+ * sets *hit if p would sit on top of another particle */
+double particleEnergy(const coord_t *x, const coord_t *y, int num_particles, int p, int px, int py, int *hit)
+{
+    double energy = 0.0;
+    int j,dx,dy,d2;
+    *hit = 0;
+    for(j = 0; j < num_particles; j++)
+    {
+        if(j == p)
+            continue;
+        dx = px - x[j];
+        dy = py - y[j];
+        d2 = (dx*dx)+(dy*dy);
+        if(d2 == 0)
+        {
+            *hit = 1;
+            return 0;
+        }
+        if(d2 <= cutoff_d2) //as in the cutoff kernel, every pair without it
+            energy += lj_table[d2];
+    }
+    return energy;
+}
+
+static inline uint64_t rotl(const uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+/* next 64 random bits of a stream (xoshiro256**) */
+static inline uint64_t rngNext(rng_state *r)
+{
+    uint64_t *s = (*r).s;
+    const uint64_t result = rotl(s[1] * 5, 7) * 9;
+    const uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return result;
+}
+
+/* random int in [0,n) */
+static inline int rngInt(rng_state *r, int n)
+{
+    return (int)(((rngNext(r) >> 32) * (uint64_t)n) >> 32);
+}
+
+/* random double in [0,1) */
+static inline double rngDouble(rng_state *r)
+{
+    return (rngNext(r) >> 11) * 0x1.0p-53;
+}
+
+/* seed the stream, splitmix64 spreads the seed over the whole state */
+void initRng(uint64_t seed)
+{
+    int i;
+    for(i = 0; i < 4; i++)
+    {
+        uint64_t z = (seed += 0x9e3779b97f4a7c15);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        rng.s[i] = z ^ (z >> 31);
+    }
+}
+
+/* Creates initial random population */
+void initPopulation(box_population *box, int xmax, int ymax)
+{
+    int i,p;
+    for(p = 0; p < (*box).size; p++)
+    {
+        coord_t *x = BOX_X(box,p);
+        coord_t *y = BOX_Y(box,p);
+        for(i=0; i<(*box).num_particles; i++)
+        {
+            x[i]=rngInt(&rng, xmax + 1);
+            y[i]=rngInt(&rng, ymax + 1);
+        }
+    }
+    evalPopulation(box, 0, (*box).size);
+}
+
+/* create the genome of child c of children from parents parentOne and parentTwo, see evalPopulation */
+void crossover(box_population *children, int c, box_population *parents, int parentOne, int parentTwo, int splitPoint)
+{
+    int num_particles = (*children).num_particles;
+    coord_t *x = BOX_X(children,c);
+    coord_t *y = BOX_Y(children,c);
+    int i = splitPoint - 1;
+    size_t head = splitPoint*sizeof(coord_t);
+    size_t tail = (num_particles - splitPoint)*sizeof(coord_t);
+    memcpy(x, BOX_X(parents,parentOne), head); //copy over parentOne up to splitPoint
+    memcpy(y, BOX_Y(parents,parentOne), head);
+    memcpy(x + splitPoint, BOX_X(parents,parentTwo) + splitPoint, tail); //copy over parentTwo from splitPoint to end
+    memcpy(y + splitPoint, BOX_Y(parents,parentTwo) + splitPoint, tail);
+    if((rngInt(&rng, 2) == 1) && (i < num_particles) &&(i >= 0)) //50% of time split in middle of particle, more mixing
+        y[i]=BOX_Y(parents,parentTwo)[i];
+}
+
+/* deep copy count boxes of b starting at j into a starting at i */
+void copyboxes(box_population *a, int i, box_population *b, int j, int count)
+{
+    size_t coords = (size_t)count*(*a).num_particles*sizeof(coord_t);
+    memcpy(BOX_X(a,i), BOX_X(b,j), coords);
+    memcpy(BOX_Y(a,i), BOX_Y(b,j), coords);
+    memcpy(&(*a).fitness[i], &(*b).fitness[j], count*sizeof(double));
+    memcpy(&(*a).overlap[i], &(*b).overlap[j], count*sizeof(int));
+}
+
+/* deep copy box j of b into box i of a [does a[i]=b[j]] */
+void copybox(box_population *a, int i, box_population *b, int j)
+{
+    copyboxes(a, i, b, j, 1);
+}
+
+/* move one random particle of the evaluated box b to a random grid point
+ * the fitness is updated from that particle's interactions only, O(N) rather than O(N^2) */
+void mutate(box_population *pop, int b, int x_max, int y_max)
+{
+    int hit;
+    double old_energy, new_energy;
+    int num_particles = (*pop).num_particles;
+    coord_t *x = BOX_X(pop,b);
+    coord_t *y = BOX_Y(pop,b);
+    int mutated = rngInt(&rng, num_particles);
+    int px = rngInt(&rng, x_max + 1);
+    int py = rngInt(&rng, y_max + 1);
+    if((*pop).overlap[b])
+    {   //fitness of overlapping particles is not a plain pair sum, so recompute it all
+        x[mutated] = px;
+        y[mutated] = py;
+        evalPopulation(pop, b, 1);
+        return;
+    }
+    old_energy = particleEnergy(x, y, num_particles, mutated, x[mutated], y[mutated], &hit);
+    new_energy = particleEnergy(x, y, num_particles, mutated, px, py, &hit);
+    x[mutated] = px;
+    y[mutated] = py;
+    if(hit) //moved on top of another particle
+        evalPopulation(pop, b, 1);
+    else
+        (*pop).fitness[b] += new_energy - old_energy;
+}
+
+// grid steps of a local search move, to one of the 8 neighbouring points
+static const int step_x[8] = {1, 1, 0, -1, -1, -1, 0, 1};
+static const int step_y[8] = {0, 1, 1, 1, 0, -1, -1, -1};
+
+/* memetic refinement of box b - try local_moves_option moves of a random particle to a neighbouring
+ * grid point and keep those that raise the fitness, each scored from that particle's interactions only, O(N) */
+void localSearch(box_population *pop, int b, int x_max, int y_max)
+{
+    int m, hit;
+    double old_energy, new_energy;
+    int num_particles = (*pop).num_particles;
+    coord_t *x = BOX_X(pop,b);
+    coord_t *y = BOX_Y(pop,b);
+    if((*pop).overlap[b])
+        return; //no pair sum to climb, mutation has to move it apart
+    for(m = 0; m < local_moves_option; m++)
+    {
+        int moved = rngInt(&rng, num_particles);
+        int step = rngInt(&rng, 8);
+        int px = x[moved] + step_x[step];
+        int py = y[moved] + step_y[step];
+        if(px < 0 || px > x_max || py < 0 || py > y_max)
+            continue; //off the grid
+        old_energy = particleEnergy(x, y, num_particles, moved, x[moved], y[moved], &hit);
+        new_energy = particleEnergy(x, y, num_particles, moved, px, py, &hit);
+        if(!hit && new_energy > old_energy)
+        {
+            x[moved] = px;
+            y[moved] = py;
+            (*pop).fitness[b] += new_energy - old_energy;
+        }
+    }
+}
+
+/* Main GA function - does selection, breeding, crossover and mutation
+ * breeds box into new_generation, the caller swaps the two buffers afterwards */
+int breeding(box_population *box, box_population *new_generation, int x_max, int y_max)
+{
+        int highest = 0;
+        int population_size = (*box).size;
+        int num_particles = (*box).num_particles;
+        int max_parent = 0; //keep track of highest from previous generation, set max to first one
+        int i,j;
+        double min_fitness = INFINITY, max_fitness = -INFINITY; //weakest and fittest child so far
+        int min_box = 0;
+
+        beginGeneration(&timer);
+        for (i = 0; i < population_size; i += 2)
+        {   //two children
+            // Determine breeding pair, with tournament of 2 (joust)
+            int one, two, splitPoint, parentOne, parentTwo;
+            enterPhase(&timer, PHASE_SELECTION);
+            do
+            {
+                one = rngInt(&rng, population_size);
+                do
+                {
+                    two = rngInt(&rng, population_size);
+                } while(one == two);
+                parentOne = two;
+                if((*box).fitness[one] > (*box).fitness[two])
+                    parentOne = one; //joust
+                one = rngInt(&rng, population_size);
+                do
+                {
+                    two = rngInt(&rng, population_size);
+                } while(one == two);
+                parentTwo = two;
+                if((*box).fitness[one] > (*box).fitness[two])
+                    parentTwo = one; //joust
+            } while(parentOne == parentTwo);
+        
+            do
+            {
+                splitPoint = rngInt(&rng, num_particles); //split chromosome at point
+            } while(splitPoint == 0 || splitPoint == num_particles - 1);
+            enterPhase(&timer, PHASE_CROSSOVER);
+            crossover(new_generation, i, box, parentOne, parentTwo, splitPoint); //first child
+
+            crossover(new_generation, i+1, box, parentTwo, parentOne, splitPoint); //second child
+            chargePhase(&timer, PHASE_OTHER); //loop control
+        }
+        evalPopulation(new_generation, 0, population_size); //all children in one batch
+
+        for (i = 0; i < population_size; i += 2)
+        {
+            // Mutation first child
+            enterPhase(&timer, PHASE_MUTATION);
+            double mutation = rngDouble(&rng);
+            if(mutation <= MUTATION_RATE)
+                mutate(new_generation, i, x_max, y_max);
+            mutation = rngDouble(&rng); //mutation second child
+            if(mutation <= MUTATION_RATE)
+                mutate(new_generation, i+1, x_max, y_max);
+
+            if(local_moves_option > 0) //memetic stage, climb to a nearby local optimum
+            {
+                enterPhase(&timer, PHASE_LOCAL);
+                localSearch(new_generation, i, x_max, y_max);
+                localSearch(new_generation, i+1, x_max, y_max);
+            }
+
+            //find maximum parent fitness to keep and minimum new generation to throw away
+            enterPhase(&timer, PHASE_ELITISM);
+            for(j = i; j < i + 2; j++)
+            {
+                if((*box).fitness[j] > (*box).fitness[max_parent])
+                {
+                    max_parent = j; //replace lowest fitness with highest parent
+                }
+                if((*new_generation).fitness[j] < min_fitness)
+                {
+                    min_fitness = (*new_generation).fitness[j];
+                    min_box = j;
+                }
+                if((*new_generation).fitness[j] > max_fitness)
+                {
+                    max_fitness = (*new_generation).fitness[j];
+                    highest = j;
+                }
+            }
+            chargePhase(&timer, PHASE_OTHER); //loop control
+        }
+    
+        // printf("max fitness should be: %f\n",(*box).fitness[max_parent]);
+        //the only copy - best parent over the weakest child
+        enterPhase(&timer, PHASE_ELITISM);
+        copybox(new_generation, min_box, box, max_parent);
+        if((*box).fitness[max_parent] > max_fitness)
+        {   //previous generation has the best
+            max_fitness=(*box).fitness[max_parent];
+            highest=min_box;
+            //printf("max fitness should be: %f",(*box).fitness[max_parent]);
+        }
+        endGeneration(&timer);
+        return highest;
+}
+
+
+/* one steady-state step - two jousts between four different boxes pick the parents and their children
+ * replace the two losers in place, so the population is never copied */
+void steadyStep(box_population *pop, box_population *children, int x_max, int y_max)
+{
+    int population_size = (*pop).size;
+    int num_particles = (*pop).num_particles;
+    int picked[4];
+    int i, j, splitPoint, parentOne, parentTwo, loserOne, loserTwo;
+    enterPhase(&timer, PHASE_SELECTION);
+    for(i = 0; i < 4; i++)
+    {
+        do
+        {
+            picked[i] = rngInt(&rng, population_size);
+            for(j = 0; j < i && picked[j] != picked[i]; j++);
+        } while(j < i); //drawn already
+    }
+    parentOne = picked[1]; //joust
+    loserOne = picked[0];
+    if((*pop).fitness[picked[0]] > (*pop).fitness[picked[1]])
+    {
+        parentOne = picked[0];
+        loserOne = picked[1];
+    }
+    parentTwo = picked[3]; //joust
+    loserTwo = picked[2];
+    if((*pop).fitness[picked[2]] > (*pop).fitness[picked[3]])
+    {
+        parentTwo = picked[2];
+        loserTwo = picked[3];
+    }
+    do
+    {
+        splitPoint = rngInt(&rng, num_particles); //split chromosome at point
+    } while(splitPoint == 0 || splitPoint == num_particles - 1);
+
+    enterPhase(&timer, PHASE_CROSSOVER);
+    crossover(children, 0, pop, parentOne, parentTwo, splitPoint);
+    crossover(children, 1, pop, parentTwo, parentOne, splitPoint);
+    evalPopulation(children, 0, 2);
+
+    enterPhase(&timer, PHASE_MUTATION);
+    if(rngDouble(&rng) <= MUTATION_RATE)
+        mutate(children, 0, x_max, y_max);
+    if(rngDouble(&rng) <= MUTATION_RATE)
+        mutate(children, 1, x_max, y_max);
+    if(local_moves_option > 0)
+    {
+        enterPhase(&timer, PHASE_LOCAL);
+        localSearch(children, 0, x_max, y_max);
+        localSearch(children, 1, x_max, y_max);
+    }
+
+    enterPhase(&timer, PHASE_ELITISM); //replacement
+    copybox(pop, loserOne, children, 0);
+    copybox(pop, loserTwo, children, 1);
+    chargePhase(&timer, PHASE_OTHER);
+}
+
+/* steady-state counterpart of breeding - as many steps as breeding makes pairs of children
+ * returns the fittest box, found by a scan as a step can overwrite the fittest box on a tie */
+int steadyState(box_population *pop, box_population *children, int x_max, int y_max)
+{
+    int i, highest = 0;
+    beginGeneration(&timer);
+    for(i = 0; i < (*pop).size/2; i++)
+        steadyStep(pop, children, x_max, y_max);
+    enterPhase(&timer, PHASE_ELITISM);
+    for(i = 1; i < (*pop).size; i++)
+        if((*pop).fitness[i] > (*pop).fitness[highest])
+            highest = i;
+    endGeneration(&timer);
+    return highest;
+}
+
+/* bytes of a checkpoint of a population of size boxes */
+size_t checkpointSize(int num_streams, int size, int num_particles)
+{
+    return sizeof(checkpoint_header) + num_streams*sizeof(rng.s) + (size_t)size*(2*num_particles*sizeof(coord_t) + sizeof(double) + sizeof(int));
+}
+
+/* set when a checkpoint header belongs to the same build and problem as this run */
+int sameRun(const checkpoint_header *a, const checkpoint_header *b)
+{
+    return memcmp((*a).magic, (*b).magic, sizeof((*a).magic)) == 0 && (*a).coord_bits == (*b).coord_bits
+        && (*a).population_size == (*b).population_size && (*a).x_max == (*b).x_max && (*a).y_max == (*b).y_max
+        && (*a).num_particles == (*b).num_particles && (*a).iter == (*b).iter && (*a).num_streams == (*b).num_streams;
+}
+
+/* background writer - the snapshot goes to a temporary file that replaces the checkpoint once it is on disk,
+ * so a run killed while writing still leaves the previous checkpoint behind */
+void *writeCheckpoint(void *arg)
+{
+    checkpoint_state *c = arg;
+    char temp[256];
+    snprintf(temp, sizeof(temp), "%s.tmp", (*c).name);
+    FILE *out = fopen(temp, "wb");
+    int ok = out != NULL && fwrite((*c).buffer, 1, (*c).bytes, out) == (*c).bytes && fflush(out) == 0 && fsync(fileno(out)) == 0;
+    if(out != NULL)
+        ok = fclose(out) == 0 && ok;
+    if(!ok || rename(temp, (*c).name) != 0)
+        printf("Error writing checkpoint %s\n", (*c).name);
+    return NULL;
+}
+
+/* wait for the snapshot being written */
+void finishCheckpoint(void)
+{
+    if(checkpoint.writing)
+        pthread_join(checkpoint.writer, NULL);
+    checkpoint.writing = 0;
+}
+
+/* snapshot the run at the start of generation gen and write it out in the background
+ * copying the population is all breeding waits for, unless the last snapshot is still being written */
+void saveCheckpoint(box_population *pop, int gen, int highest, convergence_monitor *m)
+{
+    checkpoint_header *h = &checkpoint.header;
+    char *p = checkpoint.buffer;
+    size_t coords = (size_t)(*pop).size*(*pop).num_particles*sizeof(coord_t);
+    finishCheckpoint();
+    (*h).generation = gen;
+    (*h).highest = highest;
+    (*h).best = (*m).best;
+    (*h).best_gen = (*m).best_gen;
+    (*h).fitness_evals = fitness_evals;
+    (*h).cache_hits = cache_hits;
+    (*h).elapsed = wallTime() - checkpoint.begin;
+    memcpy(p, h, sizeof(*h));
+    p += sizeof(*h);
+    memcpy(p, rng.s, sizeof(rng.s));
+    p += sizeof(rng.s);
+    memcpy(p, (*pop).x, coords);
+    memcpy(p + coords, (*pop).y, coords);
+    p += 2*coords;
+    memcpy(p, (*pop).fitness, (*pop).size*sizeof(double));
+    p += (*pop).size*sizeof(double);
+    memcpy(p, (*pop).overlap, (*pop).size*sizeof(int));
+    checkpoint.bytes = p + (*pop).size*sizeof(int) - checkpoint.buffer;
+    checkpoint.writing = pthread_create(&checkpoint.writer, NULL, writeCheckpoint, &checkpoint) == 0;
+    if(!checkpoint.writing)
+        printf("Error starting the checkpoint writer\n");
+}
+
+/* restore the generator and pop from the checkpoint of an earlier, unfinished run of this problem
+ * returns 0 if there is no checkpoint, one of another problem or build is an error */
+int loadCheckpoint(checkpoint_header *h, box_population *pop)
+{
+    FILE *in = fopen(checkpoint.name, "rb");
+    size_t bytes = checkpointSize(1, (*pop).size, (*pop).num_particles);
+    size_t coords = (size_t)(*pop).size*(*pop).num_particles*sizeof(coord_t);
+    char *buffer, *p;
+    int ok;
+    if(in == NULL)
+        return 0;
+    buffer = malloc(bytes + 1);
+    ok = fread(buffer, 1, bytes + 1, in) == bytes; //exactly the size of a checkpoint of this run
+    fclose(in);
+    if(ok)
+    {
+        memcpy(h, buffer, sizeof(*h));
+        ok = sameRun(h, &checkpoint.header);
+    }
+    if(!ok)
+    {
+        printf("%s is not a checkpoint of this run\n", checkpoint.name);
+        exit(1);
+    }
+    p = buffer + sizeof(*h);
+    memcpy(rng.s, p, sizeof(rng.s));
+    p += sizeof(rng.s);
+    memcpy((*pop).x, p, coords);
+    memcpy((*pop).y, p + coords, coords);
+    p += 2*coords;
+    memcpy((*pop).fitness, p, (*pop).size*sizeof(double));
+    p += (*pop).size*sizeof(double);
+    memcpy((*pop).overlap, p, (*pop).size*sizeof(int));
+    free(buffer);
+    return 1;
+}
+
+/* take --name=value options out of argv, leaving the positional arguments in order
+ * returns the new argument count */
+int parseOptions(int argc, char *argv[])
+{
+    int i, n = 1;
+    for(i = 1; i < argc; i++)
+    {
+        if(strncmp(argv[i], "--", 2) != 0)
+            argv[n++] = argv[i]; //positional argument
+        else if(strncmp(argv[i], "--kernel=", 9) == 0)
+            kernel_option = argv[i] + 9;
+        else if(strncmp(argv[i], "--cutoff=", 9) == 0 && atof(argv[i] + 9) >= 0)
+            cutoff_option = atof(argv[i] + 9);
+        else if(strcmp(argv[i], "--steady-state") == 0)
+            steady_state_option = 1;
+        else if(strncmp(argv[i], "--seed=", 7) == 0)
+            seed_option = strtoull(argv[i] + 7, NULL, 10);
+        else if(strncmp(argv[i], "--checkpoint=", 13) == 0 && atoi(argv[i] + 13) >= 0)
+            checkpoint_option = atoi(argv[i] + 13);
+        else if(strcmp(argv[i], "--resume") == 0)
+            resume_option = 1;
+        else if(strncmp(argv[i], "--cache=", 8) == 0 && atoi(argv[i] + 8) >= 0)
+            cache_option = atoi(argv[i] + 8);
+        else if(strncmp(argv[i], "--local-moves=", 14) == 0 && atoi(argv[i] + 14) >= 0)
+            local_moves_option = atoi(argv[i] + 14);
+        else if(strncmp(argv[i], "--patience=", 11) == 0 && atoi(argv[i] + 11) > 0)
+            patience_option = atoi(argv[i] + 11);
+        else if(strncmp(argv[i], "--min-improvement=", 18) == 0)
+            min_improvement_option = atof(argv[i] + 18);
+        else if(strncmp(argv[i], "--min-rel-improvement=", 22) == 0)
+            min_rel_improvement_option = atof(argv[i] + 22);
+        else
+        {
+            printf("Unknown option %s\n", argv[i]);
+            exit(1);
+        }
+    }
+    argv[n] = NULL;
+    return n;
+}
+
+int main(int argc, char *argv[])
+{
+    int population_size = DEFAULT_POP_SIZE;
+    int x_max = X_DEFAULT;
+    int y_max = Y_DEFAULT;
+    int num_particles = DEFAULT_NUM_PARTICLES;
+    int iter = ITERATIONS;
+    int k;
+    patience_option = TOLERANCE; //unless --patience is given
+    argc = parseOptions(argc, argv);
+    if(argc >= 2)
+    {
+        population_size = atoi(argv[1]); //size population first command line argument
+        if(argc >= 4)
+        {
+            x_max = atoi(argv[2]); //x dimension
+            y_max = atoi(argv[3]); //x dimension
+        }
+        if(argc >= 5)
+            num_particles = atoi(argv[4]);
+        if(argc == 6)
+            iter = atoi(argv[5]);
+    }
+
+    if(x_max > COORD_MAX || y_max > COORD_MAX)
+    {
+        printf("A %dx%d box needs wider coordinates than %d bits, rebuild with a larger COORD_BITS\n", x_max, y_max, COORD_BITS);
+        exit(1);
+    }
+    if(steady_state_option && population_size < 4)
+    {
+        printf("Steady-state mode needs a population of at least 4 boxes\n");
+        exit(1);
+    }
+    initRng(seed_option);
+    printf("Starting optimization with particles = %d, population=%d, width=%d,length=%d for %d iterations\n", num_particles, population_size, x_max, y_max, iter);
+
+    int gen_count = 0;
+    long eval_count = 0;
+    long hit_count = 0;
+    double total_fitness = 0;
+    double total_time = 0;
+
+    box_population generations[2]; //current and next generation, swapped after breeding
+    box_population *population = &generations[0];
+    box_population *next_generation = &generations[1];
+
+    initEnergyTable(x_max, y_max);
+    initCache(cache_option);
+    selectKernel(kernel_option);
+    checkKernel(x_max, y_max, num_particles);
+    if(cutoff_option > 0)
+        initCells(cutoff_option, x_max, y_max, num_particles);
+    printf("Using %s fitness kernel, %d-bit coordinates\n", kernel_name, COORD_BITS);
+    allocPopulation(population, population_size, num_particles); //allocate memory
+    allocPopulation(next_generation, population_size, num_particles);
+    box_population children; //of a steady-state step, before they move in
+    allocPopulation(&children, 2, num_particles);
+
+    checkpoint_header *progress = &checkpoint.header; //what the next checkpoint records
+    checkpoint_header saved; //where a resumed run carries on from
+    memcpy((*progress).magic, CHECKPOINT_MAGIC, sizeof((*progress).magic));
+    (*progress).coord_bits = COORD_BITS;
+    (*progress).population_size = population_size;
+    (*progress).x_max = x_max;
+    (*progress).y_max = y_max;
+    (*progress).num_particles = num_particles;
+    (*progress).iter = iter;
+    (*progress).num_streams = 1;
+    checkpoint.name = "checkpoint.bin";
+    if(checkpoint_option > 0)
+        checkpoint.buffer = malloc(checkpointSize(1, population_size, num_particles));
+    int resumed = resume_option && loadCheckpoint(&saved, population);
+    if(resumed)
+    {
+        printf("Resuming from %s, iteration %d, generation %d\n", checkpoint.name, saved.iteration, saved.generation);
+        gen_count = saved.gen_count;
+        eval_count = saved.eval_count;
+        hit_count = saved.hit_count;
+        total_fitness = saved.total_fitness;
+        total_time = saved.total_time;
+    }
+
+    char file_name[100];
+    char run_name[200];
+    sprintf(file_name, "solution_%d_%d_%d_%d_%d.txt", population_size, x_max, y_max, num_particles, iter);
+    sprintf(run_name, "%.100s_%d_%d_%d_%d_%d", argv[0], population_size, x_max, y_max, num_particles, iter);
+    FILE *f = fopen(file_name, resumed ? "a" : "w"); //a resumed run adds to the solutions it already found
+    FILE *results = fopen("results.txt","a");
+    FILE *timing = openTiming("timing.txt");
+    FILE *convergence = openConvergence("convergence.txt");
+    if(!resumed)
+    {
+        fprintf(results, "%s\n", run_name);
+        printf("Writing dimensions to file\n");
+        fprintf(f, "%d,%d\n", x_max, y_max); //write box dimensions as first line of file
+        fflush(f); //a resumed run only appends
+        fflush(results);
+    }
+
+    for(k = resumed ? saved.iteration : 0; k<iter; k++)
+    {   //k is number of times whole simulation is run
+        int resuming = resumed && k == saved.iteration && saved.generation > 0; //the population was restored from the checkpoint
+        if(!resuming)
+        {   // populate with initial population
+            printf("initializing population\n");
+            initPopulation(population, x_max, y_max);
+            fitness_evals = 0; //only count evaluations made while breeding
+            cache_hits = 0;
+        }
+        printf("=========%d\n", k);
+
+        double max_fitness = 0;
+        // main loop
+        int stop = 0;
+        int gen = 0,highest = 0;
+        convergence_monitor monitor;
+        startMonitor(&monitor, convergence, run_name, k);
+
+        resetTimer(&timer);
+        double begin = wallTime(); //wall time, clock() would give cpu time
+        if(resuming)
+        {
+            gen = saved.generation;
+            highest = saved.highest;
+            monitor.best = saved.best;
+            monitor.best_gen = saved.best_gen;
+            fitness_evals = saved.fitness_evals;
+            cache_hits = saved.cache_hits;
+            begin -= saved.elapsed;
+        }
+        checkpoint.begin = begin;
+        (*progress).iteration = k;
+        (*progress).gen_count = gen_count;
+        (*progress).eval_count = eval_count;
+        (*progress).hit_count = hit_count;
+        (*progress).total_fitness = total_fitness;
+        (*progress).total_time = total_time;
+
+        while(gen < MAX_GEN)
+        {
+            if(converged(&monitor, gen))
+            {
+                printf("No improvement on the best fitness (%f) after %d generations. Stopping.\n", monitor.best, patience_option);
+                break;
+            }
+            if(checkpoint_option > 0 && gen > 0 && gen%checkpoint_option == 0)
+                saveCheckpoint(population, gen, highest, &monitor);
+
+            if(steady_state_option)
+                highest = steadyState(population, &children, x_max, y_max); //in place
+            else
+            {
+                highest = breeding(population, next_generation, x_max, y_max);
+                box_population *parents = population; //children become the current generation
+                population = next_generation;
+                next_generation = parents;
+            }
+            gen += 1;
+            updateMonitor(&monitor, gen, (*population).fitness[highest]);
+        }
+
+        double end = wallTime();
+        
+        double time_spent = end - begin;
+        total_time += time_spent;
+        writeTiming(timing, run_name, k, gen, time_spent);
+
+        printf("# generations= %d \n", gen);
+        printf("Best solution:\n");
+        printbox(population, highest);
+        if(cutoff_option > 0)
+            reportCutoffError(population, highest);
+        if (f == NULL)
+        {
+            printf("Error opening file!\n");
+            exit(1);
+        }
+        printboxFile(population, highest, f);
+        printf("Fitness evaluations per generation: %f\n", (double)fitness_evals/(double)gen);
+        printf("Fitness cache: %ld hits, %ld misses\n", cache_hits, fitness_evals);
+        printf("Time taken: %f\n", time_spent);
+        printf("---------\n");
+        fprintf(results, "%f\n", (double)(*population).fitness[highest]);
+        total_fitness += (double)(*population).fitness[highest];
+        gen_count += gen;
+        eval_count += fitness_evals;
+        hit_count += cache_hits;
+        if(checkpoint_option > 0)
+        {   //mark the iteration done before its rows go out, a resumed run then starts the next one instead of repeating it
+            (*progress).iteration = k + 1;
+            (*progress).gen_count = gen_count;
+            (*progress).eval_count = eval_count;
+            (*progress).hit_count = hit_count;
+            (*progress).total_fitness = total_fitness;
+            (*progress).total_time = total_time;
+            saveCheckpoint(population, 0, highest, &monitor); //generation 0, only the totals and the generator are restored
+            finishCheckpoint();
+        }
+        fflush(f);
+        fflush(results);
+        fflush(timing);
+        fflush(convergence);
+    }
+    
+
+    finishCheckpoint();
+    if(checkpoint_option > 0 || resumed)
+        remove(checkpoint.name); //the run is complete, there is nothing left to resume
+    free(checkpoint.buffer);
+    freePopulation(&generations[0]); //release memory
+    freePopulation(&generations[1]);
+    freePopulation(&children);
+    free(lj_table);
+    if(cutoff_option > 0)
+        freeCells();
+    freeCache();
+    fprintf(results, "Average fitness: %f\n", (double)total_fitness/(double)k);
+    fprintf(results, "Average generations: %f\n", (double)gen_count/(double)k);
+    fprintf(results, "Average fitness evaluations per generation: %f\n", (double)eval_count/(double)gen_count);
+    fprintf(results, "Fitness cache hit rate: %f\n", (double)hit_count/(double)(eval_count + hit_count));
+    fprintf(results, "Average time spent per iteration: %f\n", (double)total_time/(double)k);
+    fprintf(results, "---------\n");
+    fclose(f);
+    fclose(results);
+    fclose(timing);
+    fclose(convergence);
+    return 0;
+}
+
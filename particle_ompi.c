@@ -1,568 +1,2599 @@
-/*
- * Genetic algorithm for 2D Lennard Jones particle simulation
- * M. Kuttel October 2020
- */                                                                                                                                             
-
-#include <string.h>
-#include <stdlib.h>
-#include <stdio.h>
-#include <stdbool.h>
-#include <math.h>
-#include <time.h>
-#include <mpi.h>
-
-#define DEFAULT_POP_SIZE 300 //bigger population is more costly
-#define DEFAULT_NUM_PARTICLES 30 //more PARTICLES is more costly
-
-// consts
-static const int X_DEFAULT = 20; //width of box
-static const int Y_DEFAULT = 20; //length of box
-static const double MUTATION_RATE = 0.1; //how often random mutations occur
-static const double MAX_GEN = 1000; // maximum number of generations
-static const double ITERATIONS = 10; //number of times the whole process is run
-static const double TOLERANCE = 50; //not used... yet
-
-
-//each particle has x and y location in box
-typedef struct
-{
-    int x_pos;
-    int y_pos;
-} position;
-
-// box pattern
-typedef struct
-{
-    position *particle;
-    double fitness;
-} box_pattern;
-
-//display the box pattern
-void printbox(box_pattern box,int num_particles)
-{
-    int i;
-    for(i = 0; i < num_particles - 1; i++)
-    {
-        printf("%d,%d\t", box.particle[i].x_pos, box.particle[i].y_pos);
-    }
-    printf("%d,%d\t:fitness %f\n", box.particle[i].x_pos, box.particle[i].y_pos, box.fitness);
-}
-
-//print the box pattern to file
-void printboxFile(box_pattern box,FILE *f,int num_particles )
-{
-    int i;
-    for(i = 0; i < num_particles - 1; i++)
-    {
-        fprintf(f,"%d,%d\t", box.particle[i].x_pos, box.particle[i].y_pos);
-    }
-    fprintf(f,"%d,%d\n", box.particle[i].x_pos, box.particle[i].y_pos);
-}
-
-/* FITNESS FUNCTION  - this is key*/
-double calcFitness(box_pattern box,int num_particles)
-{
-    double fitness = 0.0;
-    int i,j;
-    double x,y,r,tmp;
-    for(i = 0; i < num_particles - 1; i++)
-    {
-        for(j = i + 1; j < num_particles; j++)
-        {   //cycle through all pairs to calc distances
-            x = (double)box.particle[i].x_pos - (double)box.particle[j].x_pos;
-            y = (double)box.particle[i].y_pos - (double)box.particle[j].y_pos;
-            r=sqrt((x*x)+(y*y));
-            tmp=2.0/r;
-            //fitness-= 1.0/r; // electric repulsion
-            //fitness-= pow(tmp,6); //purely repulsive function
-            if(r == 0)
-            {
-                fitness = 0;
-                break;
-            }
-            else
-                fitness+= (pow(tmp,12)-pow(tmp,6)); //Lennard-Jones function
-        }
-    }
-    return fitness;
-}
-
-/* Creates initial random population */
-void initPopulation(box_pattern * box, int population_size,int xmax,int ymax,int num_particles)
-{
-    int i,p;
-    for(p = 0; p < population_size; p++)
-    {
-        for(i=0; i<num_particles; i++)
-        {
-            box[p].particle[i].x_pos=(rand()%(xmax + 1));
-            box[p].particle[i].y_pos=(rand()%(ymax + 1));
-        }
-        box[p].fitness=calcFitness(box[p],num_particles);
-    }
-}
-
-/* create child from parents */
-box_pattern crossover(box_pattern child, box_pattern parentOne, box_pattern parentTwo, int splitPoint,int num_particles){
-    int i=0;
-    for(i=0; i<splitPoint; i++)
-    {   //copy over parentOne up to splitPoint
-        child.particle[i].x_pos=parentOne.particle[i].x_pos;
-        child.particle[i].y_pos=parentOne.particle[i].y_pos;
-    }
-    i--;
-    if((rand()%(2) == 1) && (i < num_particles) &&(i >= 0)) //50% of time split in middle of particle, more mixing
-        child.particle[i].y_pos=parentTwo.particle[i].y_pos; //don't know if I like this tbh. Seems redundant.
-    
-    for(i = splitPoint; i < num_particles; i++)
-    {   //copy over parentTwo from splitPoint to end
-        child.particle[i].x_pos=parentTwo.particle[i].x_pos;
-        child.particle[i].y_pos=parentTwo.particle[i].y_pos;
-    }
-    child.fitness=calcFitness(child,num_particles); //calculate fitness
-    return child;
-}
-
-/* deep copy b into a [does a=b] */
-void copybox(box_pattern *a, box_pattern *b,int num_particles)
-{
-    int i;
-    for (i = 0; i < num_particles; i++){
-        (*a).particle[i].x_pos = (*b).particle[i].x_pos;
-        (*a).particle[i].y_pos = (*b).particle[i].y_pos;
-    }
-    (*a).fitness=(*b).fitness;
-}
-
-/* Main GA function - does selection, breeding, crossover and mutation */
-int breeding(box_pattern * box, int population_size, int x_max, int y_max,int num_particles)
-{
-        int highest;
-        box_pattern max_parent; //keep track of highest from previous generation
-        max_parent.particle = malloc(num_particles*sizeof(position));
-        copybox(&max_parent, &box[0], num_particles); //set max to first one
-        int i;
-        box_pattern * new_generation = (box_pattern*) malloc(sizeof(box_pattern)*(population_size));
-        for(i = 0; i < population_size; i++)
-            new_generation[i].particle = malloc(num_particles*sizeof(position));
-
-        for (i = 0; i < population_size; i += 2)
-        {   //two children
-            // Determine breeding pair, with tournament of 2 (joust)
-            int one, two, splitPoint, parentOne, parentTwo;
-            do
-            {
-                one = rand()%(population_size);
-                do
-                {
-                    two = rand()%(population_size);
-                } while(one == two);
-                parentOne = two;
-                if(box[one].fitness > box[two].fitness)
-                    parentOne = one; //joust
-                one = rand()%(population_size);
-                do
-                {
-                    two = rand()%(population_size);
-                } while(one == two);
-                parentTwo = two;
-                if(box[one].fitness > box[two].fitness)
-                    parentTwo = one; //joust
-            } while(parentOne == parentTwo);
-        
-            do
-            {
-                splitPoint = rand()%num_particles; //spl/* code */it chromosome at point
-            } while(splitPoint == 0 || splitPoint == num_particles - 1);
-            new_generation[i] = crossover(new_generation[i], box[parentOne], box[parentTwo], splitPoint, num_particles); //first child
-
-            new_generation[i+1] = crossover(new_generation[i+1], box[parentTwo], box[parentOne], splitPoint, num_particles); //second child
-
-            // Mutation first child
-            double mutation = rand()/(double)RAND_MAX;
-            if(mutation <= MUTATION_RATE)
-            {
-                int mutated;
-                do
-                {
-                    mutated = rand() % num_particles;
-                } while(mutated == num_particles);
-                new_generation[i].particle[mutated].x_pos = (rand()%(x_max + 1));
-                new_generation[i].particle[mutated].y_pos = (rand()%(y_max + 1));
-                new_generation[i].fitness = calcFitness(new_generation[i], num_particles);
-            }
-            mutation = rand()/(double)RAND_MAX; //mutation second child
-            if(mutation <= MUTATION_RATE)
-            {
-                int mutated;
-                do
-                {
-                    mutated = rand() % num_particles;
-                } while(mutated == num_particles);
-                new_generation[i+1].particle[mutated].x_pos = (rand()%(x_max + 1));
-                new_generation[i+1].particle[mutated].y_pos = (rand()%(y_max + 1));
-                new_generation[i+1].fitness = calcFitness(new_generation[i+1], num_particles);
-            }
-        }
- 
-        //find maximum parent fitness to keep and minimum new generation to throw away
-        new_generation[0].fitness = calcFitness(new_generation[0],num_particles);
-        double min_fitness = new_generation[0].fitness;
-        int min_box = 0;
-        double max_fitness = new_generation[0].fitness;
-        highest = 0;
-        for(i = 1; i < population_size; i++)
-        {
-            if(box[i].fitness > max_parent.fitness)
-            {
-                copybox(&max_parent, &box[i], num_particles); //replace lowest fitness with highest parent
-            }
-            new_generation[i].fitness=calcFitness(new_generation[i],num_particles);
-            if(new_generation[i].fitness < min_fitness)
-            {
-                min_fitness = new_generation[i].fitness;
-                min_box = i;
-            }
-            if(new_generation[i].fitness > max_fitness)
-            {
-                max_fitness = new_generation[i].fitness;
-                highest = i;
-            }
-        }
-    
-        // printf("max fitness should be: %f\n",max_parent.fitness);
-        //copies
-        for(i = 0; i < population_size; i++)
-        {
-            //printbox(new_generation[i]);
-            if(i == min_box)
-            {
-                copybox(&box[i], &max_parent, num_particles);
-            } 
-            else
-            {
-                copybox(&box[i], &new_generation[i], num_particles);
-            }
-           // printbox(box[i]);
-        }
-        if(max_parent.fitness > max_fitness)
-        {   //previous generation has the best
-            max_fitness=max_parent.fitness;
-            highest=min_box;
-            //printf("max fitness should be: %f",max_parent.fitness);
-        }
-        for(i = 0;i < population_size; i++)
-            free(new_generation[i].particle); //release memory
-        free(new_generation); //release memory
-        free(max_parent.particle);
-        return highest;
-}
-
-void send_boxes(int start, int count, int num_particles, box_pattern* data, int dest, int tag, MPI_Comm comm)
-{
-    //find correct size for buffer
-    int size = 0;
-    int tmpsize;
-    MPI_Pack_size(count, MPI_DOUBLE, comm, &tmpsize);
-    size += tmpsize;
-    MPI_Pack_size(count*num_particles*2, MPI_INT, comm, &tmpsize);
-    size += tmpsize;
-
-    char buf[size];
-    int pos = 0;
-
-    for(int b = 0; b < count; ++b)
-    {
-        //for each box, pack fitness
-        MPI_Pack(&data[start+b].fitness, 1, MPI_DOUBLE, buf, size, &pos, comm);
-
-        //for each box, pack particle postions
-        for(int p = 0; p < num_particles; ++p)
-        {
-            MPI_Pack(&data[start+b].particle[p].x_pos, 1, MPI_INT, buf, size, &pos, comm);
-            MPI_Pack(&data[start+b].particle[p].y_pos, 1, MPI_INT, buf, size, &pos, comm);
-        }
-    }
-    MPI_Send(buf, pos, MPI_PACKED, dest, tag, comm);
-}
-
-void recv_boxes(int start, int count, int num_particles, box_pattern* data, int src, int tag, MPI_Comm comm)
-{
-    MPI_Status status;
-    MPI_Probe(src, tag, comm, &status);
-    int size;
-    MPI_Get_count(&status, MPI_PACKED, &size);
-    char buf[size];
-    MPI_Recv(buf, size, MPI_PACKED, src, tag, comm, &status);
-
-    int pos = 0;
-
-    for(int b = 0; b < count; ++b)
-    {
-        //for each box, unpack fitness
-        MPI_Unpack(buf, size, &pos, &data[start+b].fitness, 1, MPI_DOUBLE, comm);
-
-        //for each box, unpack particle postions
-        for(int p = 0; p < num_particles; ++p)
-        {
-            MPI_Unpack(buf, size, &pos, &data[start+b].particle[p].x_pos, 1, MPI_INT, comm);
-            MPI_Unpack(buf, size, &pos, &data[start+b].particle[p].y_pos, 1, MPI_INT, comm);
-        }
-    }
-}
-
-int main(int argc, char *argv[])
-{
-    int rank, size;
-    MPI_Init(&argc, &argv);
-    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-    MPI_Comm_size(MPI_COMM_WORLD, &size);
-
-    int population_size = DEFAULT_POP_SIZE;
-    int x_max = X_DEFAULT;
-    int y_max = Y_DEFAULT;
-    int num_particles = DEFAULT_NUM_PARTICLES;
-    int iter = ITERATIONS;
-    int k,i;
-
-    srand(time(NULL)*rank);
-
-    if(argc >= 2)
-    {
-        population_size = atoi(argv[1]); //size population first command line argument
-        if(argc >= 4)
-        {
-            x_max = atoi(argv[2]); //x dimension
-            y_max = atoi(argv[3]); //x dimension
-        }
-        if(argc >= 5)
-            num_particles = atoi(argv[4]);
-        if(argc >= 6)
-            iter = atoi(argv[5]);
-    }
-
-    int subpopulation_size = population_size/size;
-    int exchange_amount = subpopulation_size/10;
-    int exchange_freq = MAX_GEN/100;
-    int tolerancecheck_freq = exchange_freq*5;
-
-    FILE *f;
-    FILE *results;
-    if(rank == 0)
-    {
-        printf("Starting optimization with particles = %d, population=%d, width=%d,length=%d for %d iterations\n", num_particles, population_size, x_max, y_max, iter);
-
-        char file_name[100];
-        sprintf(file_name, "solution_ompi_%d_%d_%d_%d_%d.txt", population_size, x_max, y_max, num_particles, iter);
-        f = fopen(file_name, "w");
-        results = fopen("results_ompi.txt","a");
-        fprintf(results, "%s_%d_%d_%d_%d_%d\n", argv[0], population_size, x_max, y_max, num_particles, iter);
-        printf("Writing dimensions to file\n");
-        fprintf(f, "%d,%d\n", x_max, y_max); //write box dimensions as first line of file
-    }
-    int gen_count = 0;
-    double total_time = 0;
-    double total_fitness = 0;
-
-    box_pattern * population;
-    box_pattern * exchange_boxes;
-
-    population = (box_pattern*) malloc(sizeof(box_pattern)*subpopulation_size); //allocate memory
-    for(i=0;i<subpopulation_size;i++)
-        population[i].particle = malloc(num_particles*sizeof(position)); //allocate memory
-    exchange_boxes = (box_pattern*) malloc(sizeof(box_pattern)*exchange_amount);
-    for(i=0;i<exchange_amount;i++)
-        exchange_boxes[i].particle = malloc(num_particles*sizeof(position));
-
-    if(rank == 0)
-        printf("Population size: %d, Subpop size: %d, Maxrank: %d\n", population_size, subpopulation_size, size);
-    for(k=0; k<iter; k++)
-    {   //k is number of times whole simulation is run
-        //populate with initial population for each process
-        if(rank == 0)
-            printf("=========%d\n", k);
-        printf("Initializing population for island %d\n", rank);
-        initPopulation(population, subpopulation_size, x_max, y_max, num_particles);
-        double max_fitness = 0;
-        // main loop
-        int stop = 0;
-        int gen = 0, highest = 0;
-        int current_tolerance = 0;
-        int max_tolerance = MAX_GEN*3/10;
-        int exchange_count = 0;
-
-        double begin;
-        if(rank==0)
-            begin = MPI_Wtime();
-
-        while(gen < MAX_GEN)
-        {
-            if(gen != 0 && gen%exchange_freq == 0) //check if it is time to migrate/exchange
-            {
-                int exchange_partner;
-                if(exchange_count%2==0) //even number of exchanges
-                {
-                    if(rank%2==0) //even rank
-                    {
-                        if(rank==(size-1))
-                            exchange_partner = rank;
-                        else
-                            exchange_partner = rank+1;
-                    }
-                    else //odd rank
-                        exchange_partner = rank-1;
-                }
-                else //odd number of exchanges
-                {
-                    if(rank%2==0) //even rank
-                    {
-                        if(rank==0 && size%2!=0)
-                            exchange_partner = rank;
-                        else
-                            exchange_partner = rank-1;
-                    }
-                    else //odd rank
-                        exchange_partner = (rank+1)%size;
-                }
-
-                if(rank > exchange_partner) //send first
-                {
-                    //printf("(Gen %d) Island %d is ready to exchange with %d\n", gen, rank, exchange_partner);
-
-                    send_boxes(0, exchange_amount, num_particles, population, exchange_partner, exchange_count+1, MPI_COMM_WORLD);
-
-                    recv_boxes(0, exchange_amount, num_particles, population, exchange_partner, exchange_count+1, MPI_COMM_WORLD);
-                }
-                else if (rank < exchange_partner) //receive first
-                {
-                    //printf("(Gen %d) Island %d is ready to exchange with %d\n", gen, rank, exchange_partner);
-
-                    for(int b=0; b<exchange_amount; ++b) //copy of individuals to exchange
-                        copybox(&exchange_boxes[b], &population[b], num_particles);
-
-                    recv_boxes(0, exchange_amount, num_particles, population, exchange_partner, exchange_count+1, MPI_COMM_WORLD);
-
-                    send_boxes(0, exchange_amount, num_particles, exchange_boxes, exchange_partner, exchange_count+1, MPI_COMM_WORLD);
-                }
-            }
-
-            int current_best = breeding(population, subpopulation_size, x_max, y_max, num_particles);
-            if(current_best > highest)
-            {
-                highest = current_best;
-                current_tolerance = 0;
-            }
-            else
-                current_tolerance += 1;
-
-            if(gen != 0 && gen%tolerancecheck_freq == 0) //check if it is time to report/check tolerance
-            {
-                int total_tolerance = current_tolerance;
-                MPI_Allreduce(&current_tolerance, &total_tolerance, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
-
-                double ave_tolerance = (double)total_tolerance/(double)size;
-                if(ave_tolerance > max_tolerance) //break if average greater than max
-                {
-                    if(rank==0)
-                        printf("STOPPING: Average tolerance (%f) is larger than max (%d)\n", ave_tolerance, max_tolerance);
-                    break;
-                }
-            }
-
-            gen += 1;
-        }
-
-        MPI_Barrier(MPI_COMM_WORLD);
-        int current = 0;
-        while(current < size)
-        {
-            if(rank==current)
-            {
-                printf("GA for thread %d:\n", rank);
-                printf("# generations = %d\n", gen);
-                printf("Best solution:\n");
-                printbox(population[highest], num_particles);
-                printf("\n");
-            }
-            current += 1;
-            MPI_Barrier(MPI_COMM_WORLD);
-        }
-
-        //find the highest fitness across all processes
-
-        struct // for MAXLOC reduction
-        {
-            double fitness;
-            int index;
-        } localmax, globalmax;
-
-        localmax.fitness = population[highest].fitness;
-        localmax.index = rank;
-        MPI_Allreduce(&localmax, &globalmax, 1, MPI_DOUBLE_INT, MPI_MAXLOC, MPI_COMM_WORLD);
-
-        box_pattern global_bestbox;
-        global_bestbox.particle = malloc(num_particles*sizeof(position)); //allocate memory
-
-        if(globalmax.index == 0) //if highest fitness on root
-        {
-            copybox(&global_bestbox, &population[highest], num_particles);
-        }
-        else
-        {
-            if(globalmax.index == rank)
-            {
-                send_boxes(highest, 1, num_particles, population, 0, 0, MPI_COMM_WORLD);
-            }
-            else if(rank == 0)
-            {
-                recv_boxes(0, 1, num_particles, &global_bestbox, globalmax.index, 0, MPI_COMM_WORLD);
-            } 
-        }
-
-        if(rank == 0)
-        {
-            double end = MPI_Wtime();
-            double time_spent = (double)(end - begin);
-            total_time += time_spent;
-
-            printf("Best fitness found on island %d\n", globalmax.index);
-            printf("# generations = %d\n", gen);
-            printf("Solution:\n");
-            printbox(global_bestbox, num_particles);
-            printf("\n");
-
-            if (f == NULL)
-            {
-                printf("Error opening file!\n");
-                exit(1);
-            }
-            
-            printboxFile(global_bestbox, f, num_particles);
-            printf("Time taken: %f\n", time_spent);
-            printf("---------\n");
-            fprintf(results, "%f\n", (double)global_bestbox.fitness);
-            total_fitness += global_bestbox.fitness;
-        }
-        gen_count += gen;
-    }
-
-    for(i = 0; i < subpopulation_size; i++)
-        free(population[i].particle); //release memory
-    free(population); //release memory
-    for(i = 0; i < exchange_amount; i++)
-        free(exchange_boxes[i].particle);
-    free(exchange_boxes);
-
-    if(rank==0)
-    {
-        fprintf(results, "Average fitness: %f\n", (double)total_fitness/(double)k);
-        fprintf(results, "Average generations: %f\n", (double)gen_count/(double)k);
-        fprintf(results, "Average time spent per iteration: %f\n", (double)total_time/(double)k);
-        fprintf(results, "---------\n");
-        fclose(f);
-        fclose(results);
-    }
-    MPI_Finalize();
-    return 0;
-}
-
+/*
+ * Genetic algorithm for 2D Lennard Jones particle simulation
+ * M. Kuttel October 2020
+ */                                                                                                                                             
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+#include <math.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS //vector fitness kernels, chosen at run time
+#endif
+#include <mpi.h>
+#ifdef _OPENMP
+#include <omp.h> //hybrid build, each island is bred by a thread team
+#else
+#pragma GCC diagnostic ignored "-Wunknown-pragmas" //the omp pragmas are left out, each island breeds on one thread
+#define omp_get_thread_num() 0
+#define omp_get_max_threads() 1
+typedef int omp_lock_t; //a single thread never contends
+#define omp_init_lock(lock) ((void)(lock))
+#define omp_destroy_lock(lock) ((void)(lock))
+#define omp_set_lock(lock) ((void)(lock))
+#define omp_unset_lock(lock) ((void)(lock))
+#endif
+
+#ifdef _OPENMP
+#define OUTPUT_NAME "hybrid" //solution, results and timing files
+#else
+#define OUTPUT_NAME "ompi"
+#endif
+
+#define DEFAULT_POP_SIZE 300 //bigger population is more costly
+#define DEFAULT_NUM_PARTICLES 30 //more PARTICLES is more costly
+
+// consts
+static const int X_DEFAULT = 20; //width of box
+static const int Y_DEFAULT = 20; //length of box
+static const double MUTATION_RATE = 0.1; //how often random mutations occur
+static const double MAX_GEN = 1000; // maximum number of generations
+static const double ITERATIONS = 10; //number of times the whole process is run
+static const double TOLERANCE = 50; //generations without improvement before a run stops, see --patience
+
+#define MIN_ISLAND 4 //fewest boxes an island can breed from, tournaments need three distinct boxes
+#define REBALANCE_SMOOTHING 0.3 //weight of the latest iteration in the island speeds --rebalance goes by
+#define REBALANCE_THRESHOLD 0.2 //how far the slowest island may lag the average generation time before islands are resized
+
+#define KERNEL_CHECKS 64 //random boxes used to validate a vector fitness kernel
+#define KERNEL_TOLERANCE 1e-9 //relative difference from the scalar kernel allowed
+
+
+// genome coordinate type, chosen at build time with -DCOORD_BITS=8, 16 or 32 and checked against the box in main
+// narrower coordinates put more boxes in each cache line and shrink migration messages
+#ifndef COORD_BITS
+#define COORD_BITS 16
+#endif
+#if COORD_BITS == 8
+typedef uint8_t coord_t;
+#define COORD_MAX UINT8_MAX
+#define MPI_COORD MPI_UINT8_T
+#elif COORD_BITS == 16
+typedef int16_t coord_t;
+#define COORD_MAX INT16_MAX
+#define MPI_COORD MPI_INT16_T
+#elif COORD_BITS == 32
+typedef int32_t coord_t;
+#define COORD_MAX INT32_MAX
+#define MPI_COORD MPI_INT32_T
+#else
+#error "COORD_BITS must be 8, 16 or 32"
+#endif
+
+// population of box patterns, stored as a structure of arrays in one aligned arena
+// particle i of box b is at (x[b*num_particles + i], y[b*num_particles + i])
+typedef struct
+{
+    coord_t *x;
+    coord_t *y;
+    double *fitness;
+    int *overlap; //set when two particles of a box share a grid point
+    int size; //number of boxes
+    int num_particles;
+    char *arena; //single allocation holding all of the above
+} box_population;
+
+#define ARENA_ALIGN 64 //cache line size in bytes
+
+//coordinates of box b in a population
+#define BOX_X(pop,b) ((pop)->x + (size_t)(b)*(pop)->num_particles)
+#define BOX_Y(pop,b) ((pop)->y + (size_t)(b)*(pop)->num_particles)
+
+// Lennard-Jones energy indexed by squared particle distance, built by initEnergyTable
+static double *lj_table;
+
+// number of boxes run through a fitness kernel, to report evaluations per generation, cache hits are not included
+static long fitness_evals = 0;
+
+// fitness memo, a direct-mapped table from the hash of a box's coordinates to its fitness
+// converged populations are full of clones, which then skip the O(N^2) kernel, see evalPopulation
+// only the 64-bit hash is kept, not the genome, so two boxes whose hashes collide would share a fitness
+// that is accepted, a lookup compares one stored hash, so the odds are 1 in 2^64 per evaluation
+typedef struct
+{
+    uint64_t hash; //0 marks an empty entry
+    double fitness;
+    int overlap;
+} cache_entry;
+
+#define DEFAULT_CACHE_SIZE 16384 //entries, a power of two
+static cache_entry *fitness_cache;
+static size_t cache_mask; //entries - 1, the cache is off when there are none
+#define CACHE_STRIPES 64 //locks guarding the cache, entry i is guarded by lock i % CACHE_STRIPES
+static omp_lock_t cache_locks[CACHE_STRIPES];
+static long cache_hits = 0; //boxes answered by the cache instead of a kernel
+
+// pair energy kernel for one box, see selectKernel
+typedef double (*fitness_function)(const coord_t *x, const coord_t *y, int num_particles, int *overlap);
+static fitness_function fitness_kernel;
+static const char *kernel_name;
+
+// cell list of the cutoff kernel, see calcFitnessCells, one per thread
+typedef struct
+{
+    int *head; //first particle in each cell, -1 when empty
+    int *next; //next particle in the same cell
+    double *row; //energy of particle i with the particles after it within the cutoff
+    int *row_hit; //set when particle i sits on a particle after it
+} cell_list;
+
+static cell_list *cells;
+static int num_cells; //cell lists allocated
+static int cell_size, cells_x, cells_y; //side of a cell in grid units, cells across and down the box
+static int cutoff_d2 = INT_MAX; //squared cutoff radius, pairs further apart are left out
+
+// hot path phases, timed by the phase timer and written to the timing file after every iteration
+// the breeding phases, up to PHASE_OTHER, are only timed on sampled generations as reading the clock
+// is not free next to a small fitness evaluation, their counts are exact
+enum {PHASE_SELECTION, PHASE_CROSSOVER, PHASE_MUTATION, PHASE_LOCAL, PHASE_FITNESS, PHASE_ELITISM, PHASE_OTHER, PHASE_MIGRATION, PHASE_ALLREDUCE, NUM_PHASES};
+static const char *phase_names[NUM_PHASES] = {"selection", "crossover", "mutation", "local", "fitness", "elitism", "other", "migration", "allreduce"};
+
+// wall time spent in and number of entries to each phase
+// fitness evaluations are charged to the fitness phase, not to the phase that asked for them
+typedef struct
+{
+    _Alignas(ARENA_ALIGN) double time[NUM_PHASES];
+    long count[NUM_PHASES];
+    double start; //when the running phase was entered or last charged
+    int phase; //running phase
+    int sampled; //set while a sampled generation is being timed
+    int generations; //generations bred and how many of them were sampled
+    int samples;
+} phase_timer;
+
+#define TIMING_SAMPLE 8 //one generation in this many has its breeding phases timed
+static phase_timer *timers; //one per thread, whole cache lines so threads never share one
+static int num_timers;
+
+// best fitness so far and the generation that last improved it, see updateMonitor
+typedef struct
+{
+    double best;
+    int best_gen;
+    FILE *log; //improvements are appended as run,iteration,generation,fitness rows, or NULL
+    const char *run;
+    int iteration;
+} convergence_monitor;
+
+// xoshiro256** generator state, padded to a cache line so threads never share one
+typedef struct
+{
+    uint64_t s[4];
+    char pad[ARENA_ALIGN - 4*sizeof(uint64_t)];
+} rng_state;
+
+static rng_state *rng; //one independent stream per thread of this island, see initRng
+
+// steady-state mode, see steadyStep
+static omp_lock_t *box_locks; //one per box, held by the step that is using the box
+static box_population *steady_children; //two per thread, bred before they replace the losers
+
+// where the run had got to when a checkpoint was taken, the same on every island, see saveCheckpoint
+// checkpoints are raw memory images, read back only by the same build on the same kind of machine
+typedef struct
+{
+    char magic[8]; //CHECKPOINT_MAGIC
+    int coord_bits; //the build and problem the checkpoint belongs to
+    int population_size, x_max, y_max, num_particles, iter;
+    int islands; //island sizes follow the header, then the part of every island in rank order
+    int num_streams; //generators of each island
+    int iteration; //progress of the current iteration
+    int generation; //0 when iteration has not started yet
+    int exchange_count;
+    double best; //convergence monitor of all islands
+    int best_gen;
+    double elapsed; //wall time of the iteration so far
+    int gen_count; //totals of the finished iterations
+    double total_fitness;
+    double total_time;
+} checkpoint_header;
+
+// one island's part of a checkpoint, followed by its generators and population
+typedef struct
+{
+    int size; //boxes
+    int highest;
+    double best; //convergence monitor of the island
+    int best_gen;
+    double breed_time;
+    long fitness_evals;
+    long cache_hits;
+    long eval_count; //totals of the finished iterations
+    long hit_count;
+} island_checkpoint;
+
+#define CHECKPOINT_MAGIC "GACKPT1" //changes with the layout
+
+// the latest snapshot, which every island writes its part of with non-blocking MPI-IO so that breeding never waits for the disk
+typedef struct
+{
+    checkpoint_header header; //filled in by main
+    island_checkpoint island;
+    const char *name;
+    char *buffer; //this island's part, after the header and island sizes on rank 0
+    size_t bytes;
+    MPI_File file;
+    MPI_Request write;
+    int writing; //set until the file has been closed
+} checkpoint_state;
+
+static checkpoint_state checkpoint;
+
+// island topologies for migration, see initTopology
+enum {TOPOLOGY_PAIR, TOPOLOGY_RING, TOPOLOGY_TORUS, TOPOLOGY_HYPERCUBE, TOPOLOGY_RANDOM, NUM_TOPOLOGIES};
+static const char *topology_names[NUM_TOPOLOGIES] = {"pair", "ring", "torus", "hypercube", "random"};
+
+// which boxes of an island leave as emigrants or are replaced by immigrants, see chooseBoxes
+enum {POLICY_FIRST, POLICY_BEST, POLICY_WORST, POLICY_RANDOM, NUM_POLICIES};
+static const char *policy_names[NUM_POLICIES] = {"first", "best", "worst", "random"};
+
+// islands that an exchange sends emigrants to and receives immigrants from
+typedef struct
+{
+    MPI_Comm comm; //cartesian or graph communicator of the topology, ranks as in MPI_COMM_WORLD
+    int topology;
+    int dimensions; //of the hypercube
+    int *sources;
+    int *destinations;
+    int num_sources;
+    int num_destinations;
+    int max_links; //most sources or destinations of any exchange, sizes buffers and requests
+} migration_topology;
+
+// how migrants travel: messages between linked islands, or a one-sided board every island can read
+enum {MIGRATION_MESSAGE, MIGRATION_RMA, NUM_MIGRATIONS};
+static const char *migration_names[NUM_MIGRATIONS] = {"message", "rma"};
+
+// one-sided migration board in an MPI window, each island publishes its emigrants in its own slot
+// a slot is a version and the best published fitness, then the boxes as in a population arena
+typedef struct
+{
+    MPI_Win win;
+    char *slot; //this island's slot
+    MPI_Aint header; //bytes before the boxes of a slot
+    MPI_Datatype boxes_type; //boxes of a slot, relative to the slot
+    int count; //boxes per slot
+    long version; //publications of this island
+    long *seen; //version last pulled from each island
+} migration_board;
+
+// command line options given as --name=value, see parseOptions
+static const char *kernel_option = "auto"; //--kernel=auto|scalar|avx2|avx512
+static int topology_option = TOPOLOGY_PAIR; //--topology=pair|ring|torus|hypercube|random
+static int degree_option = 2; //--degree=K, emigrant destinations of each island in the random topology
+static int emigrant_option = POLICY_FIRST; //--emigrants=first|best|worst|random
+static int replace_option = POLICY_FIRST; //--replace=first|best|worst|random
+static int migration_option = MIGRATION_MESSAGE; //--migration=message|rma
+static int rebalance_option = 0; //--rebalance, resize islands between iterations to even out generation times
+//in proportion to boxes bred per second, averaged exponentially over iterations, and only once the slowest island
+//lags the average by more than REBALANCE_THRESHOLD, as a single iteration's timings are too noisy to go by
+static uint64_t seed_option = 1; //--seed=N, every random number of every island derives from it
+static int patience_option; //--patience=N, generations without improvement before stopping, TOLERANCE by default
+static double min_improvement_option = 0; //--min-improvement=X, smallest absolute fitness gain that counts
+static double min_rel_improvement_option = 0; //--min-rel-improvement=X, smallest gain relative to the best so far
+static int local_moves_option = 0; //--local-moves=N, local search moves tried on every child, 0 turns it off
+static int cache_option = DEFAULT_CACHE_SIZE; //--cache=N, entries of the fitness cache, 0 turns it off
+static double cutoff_option = 0; //--cutoff=R, pair energies beyond radius R are left out, 0 sums all pairs
+static int steady_state_option = 0; //--steady-state, replace tournament losers in place instead of breeding generations
+static int checkpoint_option = 0; //--checkpoint=N, save the run at the first exchange after every N generations, 0 turns it off
+static int resume_option = 0; //--resume, carry on from the last checkpoint if there is one
+
+/* wall clock time in seconds */
+double wallTime(void)
+{
+    return MPI_Wtime();
+}
+
+/* charge the time since the last switch to the running phase and make p the running phase */
+void chargePhase(phase_timer *t, int p)
+{
+    if((*t).sampled)
+    {
+        double now = wallTime();
+        (*t).time[(*t).phase] += now - (*t).start;
+        (*t).start = now;
+    }
+    (*t).phase = p;
+}
+
+/* enter phase p, counting the entry */
+void enterPhase(phase_timer *t, int p)
+{
+    chargePhase(t, p);
+    (*t).count[p]++;
+}
+
+/* clear a timer at the start of an iteration */
+void resetTimer(phase_timer *t)
+{
+    memset(t, 0, sizeof(*t));
+    (*t).phase = PHASE_OTHER;
+}
+
+/* start breeding a generation, timing it if it is a sampled one */
+void beginGeneration(phase_timer *t)
+{
+    (*t).sampled = ((*t).generations++ % TIMING_SAMPLE == 0);
+    (*t).phase = PHASE_OTHER;
+    if((*t).sampled)
+    {
+        (*t).samples++;
+        (*t).start = wallTime();
+    }
+}
+
+/* finish breeding a generation */
+void endGeneration(phase_timer *t)
+{
+    chargePhase(t, PHASE_OTHER);
+    (*t).sampled = 0;
+}
+
+/* estimated time of phase p over all generations, scaled up from the sampled ones */
+double phaseTime(phase_timer *t, int p)
+{
+    if(p > PHASE_OTHER || (*t).samples == 0)
+        return (*t).time[p];
+    return (*t).time[p]*(*t).generations/(*t).samples;
+}
+
+/* timer of the calling thread */
+phase_timer *threadTimer(void)
+{
+    return &timers[omp_get_thread_num()];
+}
+
+/* allocate one phase timer per thread */
+void initTimers(int num_threads)
+{
+    num_timers = num_threads;
+    timers = aligned_alloc(ARENA_ALIGN, num_threads*sizeof(phase_timer));
+}
+
+/* charge the time since begin to phase p, on every generation as communication is rare */
+void addPhase(phase_timer *t, int p, double begin)
+{
+    (*t).time[p] += wallTime() - begin;
+    (*t).count[p]++;
+}
+
+/* open the timing file for appending, with a header line if it is new
+ * rows are run,iteration,phase,count,mean_seconds,max_seconds */
+FILE *openTiming(const char *file_name)
+{
+    FILE *timing = fopen(file_name, "a");
+    if(timing == NULL)
+    {
+        printf("Error opening file!\n");
+        exit(1);
+    }
+    fseek(timing, 0, SEEK_END);
+    if(ftell(timing) == 0)
+        fprintf(timing, "run,iteration,phase,count,mean_seconds,max_seconds\n");
+    return timing;
+}
+
+/* phase counts summed, and mean and max phase times taken, over the threads of all islands, collective
+ * the results are only on rank 0, communication is timed on the master thread of each island, so its mean is over islands */
+void reduceTiming(long *count, double *mean, double *max)
+{
+    int p, t, size;
+    long local_count[NUM_PHASES];
+    double local_mean[NUM_PHASES], local_max[NUM_PHASES];
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    for(p = 0; p < NUM_PHASES; p++)
+    {
+        int threads = p > PHASE_OTHER ? 1 : num_timers;
+        local_count[p] = 0;
+        local_mean[p] = local_max[p] = 0.0;
+        for(t = 0; t < threads; t++)
+        {
+            local_count[p] += timers[t].count[p];
+            local_mean[p] += phaseTime(&timers[t], p)/threads;
+            local_max[p] = fmax(local_max[p], phaseTime(&timers[t], p));
+        }
+    }
+    MPI_Reduce(local_count, count, NUM_PHASES, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(local_mean, mean, NUM_PHASES, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(local_max, max, NUM_PHASES, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    for(p = 0; p < NUM_PHASES; p++)
+        mean[p] /= size; //only meaningful on rank 0
+}
+
+/* append the phase breakdown of one iteration, from reduceTiming, to the timing file, closed by its total wall time */
+void writeTiming(FILE *timing, const char *run, int iteration, int generations, double time_spent, long *count, double *mean, double *max)
+{
+    int p;
+    for(p = 0; p < NUM_PHASES; p++)
+        fprintf(timing, "%s,%d,%s,%ld,%f,%f\n", run, iteration, phase_names[p], count[p], mean[p], max[p]);
+    fprintf(timing, "%s,%d,total,%d,%f,%f\n", run, iteration, generations, time_spent, time_spent);
+}
+
+/* open the convergence log for appending, with a header line if it is new */
+FILE *openConvergence(const char *file_name)
+{
+    FILE *log = fopen(file_name, "a");
+    if(log == NULL)
+    {
+        printf("Error opening file!\n");
+        exit(1);
+    }
+    fseek(log, 0, SEEK_END);
+    if(ftell(log) == 0)
+        fprintf(log, "run,iteration,generation,fitness\n");
+    return log;
+}
+
+/* start tracking the best fitness of a new iteration, improvements go to log unless it is NULL */
+void startMonitor(convergence_monitor *m, FILE *log, const char *run, int iteration)
+{
+    (*m).best = -INFINITY;
+    (*m).best_gen = 0;
+    (*m).log = log;
+    (*m).run = run;
+    (*m).iteration = iteration;
+}
+
+/* record the best fitness of generation gen
+ * returns 1 if it beats the best so far by more than both the absolute and the relative threshold */
+int updateMonitor(convergence_monitor *m, int gen, double fitness)
+{
+    double gain = fitness - (*m).best;
+    if((*m).best != -INFINITY && (gain <= min_improvement_option || gain <= min_rel_improvement_option*fabs((*m).best)))
+        return 0;
+    (*m).best = fitness;
+    (*m).best_gen = gen;
+    if((*m).log != NULL)
+        fprintf((*m).log, "%s,%d,%d,%f\n", (*m).run, (*m).iteration, gen, fitness);
+    return 1;
+}
+
+/* set once patience_option generations have gone by without an improvement */
+int converged(convergence_monitor *m, int gen)
+{
+    return gen - (*m).best_gen >= patience_option;
+}
+
+/* round a size in bytes up to a whole number of cache lines */
+size_t alignArena(size_t bytes)
+{
+    return (bytes + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+/* allocate a population of boxes as one contiguous, aligned arena */
+void allocPopulation(box_population *pop, int size, int num_particles)
+{
+    //the regions after the coordinates let the vector kernels load a full register past the last particle
+    size_t coords = alignArena((size_t)size*num_particles*sizeof(coord_t));
+    size_t fitness = alignArena((size_t)size*sizeof(double));
+    size_t overlap = alignArena((size_t)size*sizeof(int));
+    (*pop).arena = aligned_alloc(ARENA_ALIGN, 2*coords + fitness + overlap);
+    if((*pop).arena == NULL)
+    {
+        printf("Error allocating population!\n");
+        exit(1);
+    }
+    (*pop).x = (coord_t*)(*pop).arena;
+    (*pop).y = (coord_t*)((*pop).arena + coords);
+    (*pop).fitness = (double*)((*pop).arena + 2*coords);
+    (*pop).overlap = (int*)((*pop).arena + 2*coords + fitness);
+    (*pop).size = size;
+    (*pop).num_particles = num_particles;
+}
+
+/* release the arena of a population */
+void freePopulation(box_population *pop)
+{
+    free((*pop).arena);
+    (*pop).arena = NULL;
+}
+
+//display the box pattern
+void printbox(box_population *pop, int b)
+{
+    int i;
+    const coord_t *x = BOX_X(pop,b);
+    const coord_t *y = BOX_Y(pop,b);
+    for(i = 0; i < (*pop).num_particles - 1; i++)
+    {
+        printf("%d,%d\t", x[i], y[i]);
+    }
+    printf("%d,%d\t:fitness %f\n", x[i], y[i], (*pop).fitness[b]);
+}
+
+//print the box pattern to file
+void printboxFile(box_population *pop, int b, FILE *f)
+{
+    int i;
+    const coord_t *x = BOX_X(pop,b);
+    const coord_t *y = BOX_Y(pop,b);
+    for(i = 0; i < (*pop).num_particles - 1; i++)
+    {
+        fprintf(f,"%d,%d\t", x[i], y[i]);
+    }
+    fprintf(f,"%d,%d\n", x[i], y[i]);
+}
+
+static inline uint64_t rotl(const uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+/* next 64 random bits of a stream (xoshiro256**) */
+static inline uint64_t rngNext(rng_state *r)
+{
+    uint64_t *s = (*r).s;
+    const uint64_t result = rotl(s[1] * 5, 7) * 9;
+    const uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return result;
+}
+
+/* random int in [0,n) */
+static inline int rngInt(rng_state *r, int n)
+{
+    return (int)(((rngNext(r) >> 32) * (uint64_t)n) >> 32);
+}
+
+/* random double in [0,1) */
+static inline double rngDouble(rng_state *r)
+{
+    return (rngNext(r) >> 11) * 0x1.0p-53;
+}
+
+/* advance a stream by 2^128 steps, so streams started from one seed never overlap */
+void rngJump(rng_state *r)
+{
+    static const uint64_t JUMP[] = { 0x180ec6d33cfd0aba, 0xd5a61266f0c9392c, 0xa9582618e03fc9aa, 0x39abdc4529b1661c };
+    uint64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    int i,b;
+    for(i = 0; i < 4; i++)
+    {
+        for(b = 0; b < 64; b++)
+        {
+            if(JUMP[i] & UINT64_C(1) << b)
+            {
+                s0 ^= (*r).s[0];
+                s1 ^= (*r).s[1];
+                s2 ^= (*r).s[2];
+                s3 ^= (*r).s[3];
+            }
+            rngNext(r);
+        }
+    }
+    (*r).s[0] = s0;
+    (*r).s[1] = s1;
+    (*r).s[2] = s2;
+    (*r).s[3] = s3;
+}
+
+/* one stream per thread, all derived from seed and never overlapping between threads or islands:
+ * stream s starts s jumps after the first, and this island's threads use streams first..first+num_threads-1 */
+void initRng(uint64_t seed, int first, int num_threads)
+{
+    int i,t;
+    rng = aligned_alloc(ARENA_ALIGN, num_threads*sizeof(rng_state));
+    for(i = 0; i < 4; i++)
+    {   //splitmix64 spreads the seed over the whole state
+        uint64_t z = (seed += 0x9e3779b97f4a7c15);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        rng[0].s[i] = z ^ (z >> 31);
+    }
+    for(t = 0; t < first; t++)
+        rngJump(&rng[0]);
+    for(t = 1; t < num_threads; t++)
+    {
+        rng[t] = rng[t-1];
+        rngJump(&rng[t]);
+    }
+}
+
+/* precompute Lennard-Jones energy for every squared distance that fits in the box */
+void initEnergyTable(int x_max, int y_max)
+{
+    int d2;
+    long long max_d2 = (long long)x_max*x_max + (long long)y_max*y_max; //particles lie in [0,x_max]x[0,y_max]
+    double r,tmp;
+    if(max_d2 >= INT_MAX) //the kernels index the table with int squared distances
+    {
+        printf("A %dx%d box is too big for the energy table, its squared diagonal has to fit an int\n", x_max, y_max);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    lj_table = malloc(((size_t)max_d2 + 1)*sizeof(double)); //grows with the box area, 17 GB for 32767x32767
+    if(lj_table == NULL)
+    {
+        printf("Error allocating the energy table of a %dx%d box!\n", x_max, y_max);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    lj_table[0] = 0; //coincident particles are handled in calcFitness
+    for(d2 = 1; d2 <= max_d2; d2++)
+    {
+        r=sqrt((double)d2);
+        tmp=2.0/r;
+        //lj_table[d2]= -1.0/r; // electric repulsion
+        //lj_table[d2]= -pow(tmp,6); //purely repulsive function
+        lj_table[d2]= (pow(tmp,12)-pow(tmp,6)); //Lennard-Jones function
+    }
+}
+
+/* FITNESS FUNCTION  - this is key
+ * plain C version of the pair kernel, the reference for the vector kernels */
+double calcFitnessScalar(const coord_t *x, const coord_t *y, int num_particles, int *overlap)
+{
+    double fitness = 0.0;
+    int i,j;
+    int dx,dy,d2;
+    *overlap = 0;
+    for(i = 0; i < num_particles - 1; i++)
+    {
+        for(j = i + 1; j < num_particles; j++)
+        {   //cycle through all pairs to calc distances
+            dx = x[i] - x[j];
+            dy = y[i] - y[j];
+            d2=(dx*dx)+(dy*dy); //squared distance is an integer, so look up the energy
+            if(d2 == 0)
+            {
+                fitness = 0;
+                *overlap = 1;
+                break;
+            }
+            else
+                fitness+= lj_table[d2]; //Lennard-Jones function
+        }
+    }
+    return fitness;
+}
+
+#ifdef HAVE_X86_KERNELS
+// coordinates j..j+7 or j..j+15 widened to 32-bit lanes, the narrow types are loaded whole and the
+// lanes past the last particle are masked off afterwards, the arena always has room for the full load
+#if COORD_BITS == 8
+#define LOAD8_COORDS(p,lanes) _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(p)))
+#define LOAD16_COORDS(p,lanes) _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)(p)))
+#elif COORD_BITS == 16
+#define LOAD8_COORDS(p,lanes) _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(p)))
+#define LOAD16_COORDS(p,lanes) _mm512_cvtepi16_epi32(_mm256_loadu_si256((const __m256i*)(p)))
+#else
+#define LOAD8_COORDS(p,lanes) _mm256_maskload_epi32((const int*)(p), lanes)
+#define LOAD16_COORDS(p,lanes) _mm512_maskz_loadu_epi32(lanes, p)
+#endif
+
+// sliding window of lane masks, load from tail_mask + 8 - n to enable the first n lanes
+static const int tail_mask[16] = {-1, -1, -1, -1, -1, -1, -1, -1, 0, 0, 0, 0, 0, 0, 0, 0};
+
+/* AVX2 pair kernel - particle i against 8 partners at a time
+ * a coincident pair anywhere in row i zeroes the fitness, exactly as the scalar break does */
+__attribute__((target("avx2")))
+double calcFitnessAVX2(const coord_t *x, const coord_t *y, int num_particles, int *overlap)
+{
+    double fitness = 0.0;
+    int i,j;
+    const __m256i zero = _mm256_setzero_si256();
+    *overlap = 0;
+    for(i = 0; i < num_particles - 1; i++)
+    {
+        __m256i xi = _mm256_set1_epi32(x[i]);
+        __m256i yi = _mm256_set1_epi32(y[i]);
+        __m256i hits = zero;
+        __m256d sum = _mm256_setzero_pd();
+        for(j = i + 1; j < num_particles; j += 8)
+        {
+            int left = num_particles - j;
+            __m256i lanes = _mm256_loadu_si256((const __m256i*)(tail_mask + 8 - (left < 8 ? left : 8)));
+            __m256i dx = _mm256_sub_epi32(xi, LOAD8_COORDS(x + j, lanes));
+            __m256i dy = _mm256_sub_epi32(yi, LOAD8_COORDS(y + j, lanes));
+            __m256i d2 = _mm256_add_epi32(_mm256_mullo_epi32(dx, dx), _mm256_mullo_epi32(dy, dy));
+            hits = _mm256_or_si256(hits, _mm256_and_si256(lanes, _mm256_cmpeq_epi32(d2, zero)));
+            //gather energies, 4 doubles per gather, skipping lanes past the last particle
+            __m256d lo_lanes = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm256_castsi256_si128(lanes)));
+            __m256d hi_lanes = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm256_extracti128_si256(lanes, 1)));
+            sum = _mm256_add_pd(sum, _mm256_mask_i32gather_pd(_mm256_setzero_pd(), lj_table, _mm256_castsi256_si128(d2), lo_lanes, 8));
+            sum = _mm256_add_pd(sum, _mm256_mask_i32gather_pd(_mm256_setzero_pd(), lj_table, _mm256_extracti128_si256(d2, 1), hi_lanes, 8));
+        }
+        if(!_mm256_testz_si256(hits, hits))
+        {
+            fitness = 0;
+            *overlap = 1;
+        }
+        else
+        {
+            __m128d pair = _mm_add_pd(_mm256_castpd256_pd128(sum), _mm256_extractf128_pd(sum, 1));
+            fitness += _mm_cvtsd_f64(_mm_add_sd(pair, _mm_unpackhi_pd(pair, pair)));
+        }
+    }
+    return fitness;
+}
+
+/* AVX-512 pair kernel - particle i against 16 partners at a time, tail handled with lane masks */
+__attribute__((target("avx512f")))
+double calcFitnessAVX512(const coord_t *x, const coord_t *y, int num_particles, int *overlap)
+{
+    double fitness = 0.0;
+    int i,j;
+    const __m512i zero = _mm512_setzero_si512();
+    *overlap = 0;
+    for(i = 0; i < num_particles - 1; i++)
+    {
+        __m512i xi = _mm512_set1_epi32(x[i]);
+        __m512i yi = _mm512_set1_epi32(y[i]);
+        __mmask16 hits = 0;
+        __m512d sum = _mm512_setzero_pd();
+        for(j = i + 1; j < num_particles; j += 16)
+        {
+            int left = num_particles - j;
+            __mmask16 lanes = left < 16 ? (__mmask16)((1u << left) - 1) : (__mmask16)0xFFFF;
+            __m512i dx = _mm512_sub_epi32(xi, LOAD16_COORDS(x + j, lanes));
+            __m512i dy = _mm512_sub_epi32(yi, LOAD16_COORDS(y + j, lanes));
+            __m512i d2 = _mm512_add_epi32(_mm512_mullo_epi32(dx, dx), _mm512_mullo_epi32(dy, dy));
+            hits |= _mm512_mask_cmpeq_epi32_mask(lanes, d2, zero);
+            sum = _mm512_add_pd(sum, _mm512_mask_i32gather_pd(_mm512_setzero_pd(), (__mmask8)lanes, _mm512_castsi512_si256(d2), lj_table, 8));
+            sum = _mm512_add_pd(sum, _mm512_mask_i32gather_pd(_mm512_setzero_pd(), (__mmask8)(lanes >> 8), _mm512_extracti64x4_epi64(d2, 1), lj_table, 8));
+        }
+        if(hits)
+        {
+            fitness = 0;
+            *overlap = 1;
+        }
+        else
+            fitness += _mm512_reduce_add_pd(sum);
+    }
+    return fitness;
+}
+#endif
+
+/* O(N) cutoff kernel - bins the particles into cells of cutoff size and pairs each particle only with
+ * those in its own and the 8 neighbouring cells, leaving out pairs beyond the cutoff radius
+ * the energies are summed per row and the rows folded in order, so an overlap zeroes the fitness
+ * exactly as in the all-pairs kernels */
+double calcFitnessCells(const coord_t *x, const coord_t *y, int num_particles, int *overlap)
+{
+    cell_list *c = &cells[omp_get_thread_num()];
+    double fitness = 0.0;
+    int i,j,cx,cy,nx,ny;
+    int dx,dy,d2;
+    for(i = 0; i < cells_x*cells_y; i++)
+        (*c).head[i] = -1;
+    for(i = num_particles - 1; i >= 0; i--)
+    {
+        int cell = (y[i]/cell_size)*cells_x + x[i]/cell_size;
+        (*c).next[i] = (*c).head[cell];
+        (*c).head[cell] = i;
+        (*c).row[i] = 0.0;
+        (*c).row_hit[i] = 0;
+    }
+    for(i = 0; i < num_particles; i++)
+    {
+        cx = x[i]/cell_size;
+        cy = y[i]/cell_size;
+        for(ny = (cy > 0 ? cy - 1 : 0); ny <= cy + 1 && ny < cells_y; ny++)
+        {
+            for(nx = (cx > 0 ? cx - 1 : 0); nx <= cx + 1 && nx < cells_x; nx++)
+            {
+                for(j = (*c).head[ny*cells_x + nx]; j >= 0; j = (*c).next[j])
+                {
+                    if(j <= i)
+                        continue; //every pair once, in the row of its first particle
+                    dx = x[i] - x[j];
+                    dy = y[i] - y[j];
+                    d2 = (dx*dx)+(dy*dy);
+                    if(d2 == 0)
+                        (*c).row_hit[i] = 1;
+                    else if(d2 <= cutoff_d2)
+                        (*c).row[i] += lj_table[d2];
+                }
+            }
+        }
+    }
+    *overlap = 0;
+    for(i = 0; i < num_particles - 1; i++)
+    {
+        if((*c).row_hit[i])
+        {
+            fitness = 0;
+            *overlap = 1;
+        }
+        else
+            fitness += (*c).row[i];
+    }
+    return fitness;
+}
+
+/* switch to the cutoff kernel with the given radius, for boxes of num_particles particles */
+void initCells(double cutoff, int x_max, int y_max, int num_particles)
+{
+    int i;
+    cutoff = fmin(cutoff, hypot(x_max, y_max)); //no pair is further apart, and the squared diagonal fits an int
+    cell_size = (int)ceil(cutoff);
+    cutoff_d2 = (int)(cutoff*cutoff);
+    cells_x = x_max/cell_size + 1;
+    cells_y = y_max/cell_size + 1;
+    num_cells = omp_get_max_threads();
+    cells = malloc(num_cells*sizeof(cell_list));
+    for(i = 0; i < num_cells; i++)
+    {
+        cells[i].head = malloc(cells_x*cells_y*sizeof(int));
+        cells[i].next = malloc(num_particles*sizeof(int));
+        cells[i].row = malloc(num_particles*sizeof(double));
+        cells[i].row_hit = malloc(num_particles*sizeof(int));
+    }
+    fitness_kernel = calcFitnessCells;
+    kernel_name = "cells";
+}
+
+/* release the cell lists */
+void freeCells(void)
+{
+    int i;
+    for(i = 0; i < num_cells; i++)
+    {
+        free(cells[i].head);
+        free(cells[i].next);
+        free(cells[i].row);
+        free(cells[i].row_hit);
+    }
+    free(cells);
+}
+
+/* print how far the cutoff fitness of box b is from the exact all-pairs sum */
+void reportCutoffError(box_population *pop, int b)
+{
+    int overlap;
+    double exact = calcFitnessScalar(BOX_X(pop,b), BOX_Y(pop,b), (*pop).num_particles, &overlap);
+    double error = (*pop).fitness[b] - exact;
+    printf("Cutoff energy error of the best box: %f (%g relative)\n", error, error/fmax(1.0, fabs(exact)));
+}
+
+/* pick the fitness kernel named by --kernel, "auto" takes the widest the CPU supports */
+void selectKernel(const char *name)
+{
+    fitness_kernel = calcFitnessScalar;
+    kernel_name = "scalar";
+#ifdef HAVE_X86_KERNELS
+    __builtin_cpu_init();
+    if((strcmp(name, "auto") == 0 || strcmp(name, "avx512") == 0) && __builtin_cpu_supports("avx512f"))
+    {
+        fitness_kernel = calcFitnessAVX512;
+        kernel_name = "avx512";
+    }
+    else if((strcmp(name, "auto") == 0 || strcmp(name, "avx2") == 0) && __builtin_cpu_supports("avx2"))
+    {
+        fitness_kernel = calcFitnessAVX2;
+        kernel_name = "avx2";
+    }
+#endif
+    if(strcmp(name, "auto") != 0 && strcmp(name, kernel_name) != 0)
+        printf("Fitness kernel %s is not available, using %s\n", name, kernel_name);
+}
+
+/* validate the selected kernel against the scalar one on random boxes,
+ * falls back to the scalar kernel if they disagree */
+void checkKernel(int x_max, int y_max, int num_particles)
+{
+    int b,i;
+    int overlap, ref_overlap;
+    double fitness, ref_fitness;
+    unsigned int seed = 12345; //private generator, so the GA's random streams are untouched
+    coord_t *x,*y;
+    if(fitness_kernel == calcFitnessScalar)
+        return;
+    x = malloc((num_particles + 16)*sizeof(coord_t)); //room for a full register past the last particle
+    y = malloc((num_particles + 16)*sizeof(coord_t));
+    for(b = 0; b < KERNEL_CHECKS; b++)
+    {
+        for(i = 0; i < num_particles; i++)
+        {
+            seed = seed*1103515245 + 12345;
+            x[i] = (seed >> 16)%(x_max + 1);
+            seed = seed*1103515245 + 12345;
+            y[i] = (seed >> 16)%(y_max + 1);
+        }
+        ref_fitness = calcFitnessScalar(x, y, num_particles, &ref_overlap);
+        fitness = fitness_kernel(x, y, num_particles, &overlap);
+        if(overlap != ref_overlap || fabs(fitness - ref_fitness) > KERNEL_TOLERANCE*fmax(1.0, fabs(ref_fitness)))
+        {
+            printf("Fitness kernel %s disagrees with scalar (%f vs %f), using scalar\n", kernel_name, fitness, ref_fitness);
+            fitness_kernel = calcFitnessScalar;
+            kernel_name = "scalar";
+            break;
+        }
+    }
+    free(x);
+    free(y);
+}
+
+/* allocate an empty fitness cache of at least entries entries, rounded up to a power of two
+ * no entries turns the cache off, each entry is read and written under its stripe lock */
+void initCache(size_t entries)
+{
+    size_t size = 1, i;
+    cache_mask = 0;
+    if(entries == 0)
+        return;
+    while(size < entries)
+        size *= 2;
+    fitness_cache = calloc(size, sizeof(cache_entry));
+    if(fitness_cache == NULL)
+    {
+        printf("Error allocating fitness cache!\n");
+        exit(1);
+    }
+    cache_mask = size - 1;
+    for(i = 0; i < CACHE_STRIPES; i++)
+        omp_init_lock(&cache_locks[i]);
+}
+
+/* release the fitness cache */
+void freeCache(void)
+{
+    int i;
+    if(fitness_cache == NULL)
+        return; //--cache=0, the locks were never set up
+    for(i = 0; i < CACHE_STRIPES; i++)
+        omp_destroy_lock(&cache_locks[i]);
+    free(fitness_cache);
+}
+
+/* 64-bit FNV-1a hash of the coordinates of a box, a coordinate widened to 32 bits at a time, never 0 */
+uint64_t hashBox(const coord_t *x, const coord_t *y, int num_particles)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    int i;
+    for(i = 0; i < num_particles; i++)
+        hash = (hash ^ (uint32_t)x[i])*1099511628211ULL;
+    for(i = 0; i < num_particles; i++)
+        hash = (hash ^ (uint32_t)y[i])*1099511628211ULL;
+    return hash ? hash : 1;
+}
+
+/* fitness and overlap flag of the box with this hash, returns 1 if the cache holds it */
+int cacheLookup(uint64_t hash, double *fitness, int *overlap)
+{
+    size_t i = hash & cache_mask;
+    int hit;
+    omp_set_lock(&cache_locks[i % CACHE_STRIPES]);
+    hit = fitness_cache[i].hash == hash;
+    if(hit)
+    {
+        *fitness = fitness_cache[i].fitness;
+        *overlap = fitness_cache[i].overlap;
+    }
+    omp_unset_lock(&cache_locks[i % CACHE_STRIPES]);
+    return hit;
+}
+
+/* remember the fitness of the box with this hash, evicting whatever shared its entry */
+void cacheStore(uint64_t hash, double fitness, int overlap)
+{
+    size_t i = hash & cache_mask;
+    omp_set_lock(&cache_locks[i % CACHE_STRIPES]);
+    fitness_cache[i].hash = hash;
+    fitness_cache[i].fitness = fitness;
+    fitness_cache[i].overlap = overlap;
+    omp_unset_lock(&cache_locks[i % CACHE_STRIPES]);
+}
+
+/* evaluate boxes start..start+count-1 of a population with the selected kernel, or from the fitness cache
+ * where it has seen a box, storing their fitness and overlap flags
+ * the one place fitness is computed, so the phase timer and the counters are updated once per batch */
+void evalPopulation(box_population *pop, int start, int count)
+{
+    phase_timer *t = threadTimer();
+    int resume = (*t).phase;
+    int num_particles = (*pop).num_particles;
+    long hits = 0;
+    int b;
+    enterPhase(t, PHASE_FITNESS);
+    for(b = start; b < start + count; b++)
+    {
+        const coord_t *x = BOX_X(pop,b);
+        const coord_t *y = BOX_Y(pop,b);
+        int *overlap = &(*pop).overlap[b];
+        if(cache_mask == 0)
+            (*pop).fitness[b] = fitness_kernel(x, y, num_particles, overlap);
+        else
+        {   //clones hash the same, only the first of them runs the kernel
+            uint64_t hash = hashBox(x, y, num_particles);
+            if(cacheLookup(hash, &(*pop).fitness[b], overlap))
+                hits++;
+            else
+            {
+                (*pop).fitness[b] = fitness_kernel(x, y, num_particles, overlap);
+                cacheStore(hash, (*pop).fitness[b], *overlap);
+            }
+        }
+    }
+    #pragma omp atomic
+    fitness_evals += count - hits;
+    #pragma omp atomic
+    cache_hits += hits;
+    chargePhase(t, resume);
+}
+
+
+/* energy between particle p placed at (px,py) and all other particles - O(N)
+ * sets *hit if p would sit on top of another particle */
+double particleEnergy(const coord_t *x, const coord_t *y, int num_particles, int p, int px, int py, int *hit)
+{
+    double energy = 0.0;
+    int j,dx,dy,d2;
+    *hit = 0;
+    for(j = 0; j < num_particles; j++)
+    {
+        if(j == p)
+            continue;
+        dx = px - x[j];
+        dy = py - y[j];
+        d2 = (dx*dx)+(dy*dy);
+        if(d2 == 0)
+        {
+            *hit = 1;
+            return 0;
+        }
+        if(d2 <= cutoff_d2) //as in the cutoff kernel, every pair without it
+            energy += lj_table[d2];
+    }
+    return energy;
+}
+
+/* Creates initial random population */
+void initPopulation(box_population *box, int xmax, int ymax, rng_state *r)
+{
+    int i,p;
+    for(p = 0; p < (*box).size; p++)
+    {
+        coord_t *x = BOX_X(box,p);
+        coord_t *y = BOX_Y(box,p);
+        for(i=0; i<(*box).num_particles; i++)
+        {
+            x[i]=rngInt(r, xmax + 1);
+            y[i]=rngInt(r, ymax + 1);
+        }
+    }
+    evalPopulation(box, 0, (*box).size);
+}
+
+/* create the genome of child c of children from parents parentOne and parentTwo, see evalPopulation */
+void crossover(box_population *children, int c, box_population *parents, int parentOne, int parentTwo, int splitPoint, rng_state *r)
+{
+    int num_particles = (*children).num_particles;
+    coord_t *x = BOX_X(children,c);
+    coord_t *y = BOX_Y(children,c);
+    int i = splitPoint - 1;
+    size_t head = splitPoint*sizeof(coord_t);
+    size_t tail = (num_particles - splitPoint)*sizeof(coord_t);
+    memcpy(x, BOX_X(parents,parentOne), head); //copy over parentOne up to splitPoint
+    memcpy(y, BOX_Y(parents,parentOne), head);
+    memcpy(x + splitPoint, BOX_X(parents,parentTwo) + splitPoint, tail); //copy over parentTwo from splitPoint to end
+    memcpy(y + splitPoint, BOX_Y(parents,parentTwo) + splitPoint, tail);
+    if((rngInt(r, 2) == 1) && (i < num_particles) &&(i >= 0)) //50% of time split in middle of particle, more mixing
+        y[i]=BOX_Y(parents,parentTwo)[i]; //don't know if I like this tbh. Seems redundant.
+}
+
+/* deep copy count boxes of b starting at j into a starting at i */
+void copyboxes(box_population *a, int i, box_population *b, int j, int count)
+{
+    size_t coords = (size_t)count*(*a).num_particles*sizeof(coord_t);
+    memcpy(BOX_X(a,i), BOX_X(b,j), coords);
+    memcpy(BOX_Y(a,i), BOX_Y(b,j), coords);
+    memcpy(&(*a).fitness[i], &(*b).fitness[j], count*sizeof(double));
+    memcpy(&(*a).overlap[i], &(*b).overlap[j], count*sizeof(int));
+}
+
+/* deep copy box j of b into box i of a [does a[i]=b[j]] */
+void copybox(box_population *a, int i, box_population *b, int j)
+{
+    copyboxes(a, i, b, j, 1);
+}
+
+/* move one random particle of the evaluated box b to a random grid point
+ * the fitness is updated from that particle's interactions only, O(N) rather than O(N^2) */
+void mutate(box_population *pop, int b, int x_max, int y_max, rng_state *r)
+{
+    int hit;
+    double old_energy, new_energy;
+    int num_particles = (*pop).num_particles;
+    coord_t *x = BOX_X(pop,b);
+    coord_t *y = BOX_Y(pop,b);
+    int mutated = rngInt(r, num_particles);
+    int px = rngInt(r, x_max + 1);
+    int py = rngInt(r, y_max + 1);
+    if((*pop).overlap[b])
+    {   //fitness of overlapping particles is not a plain pair sum, so recompute it all
+        x[mutated] = px;
+        y[mutated] = py;
+        evalPopulation(pop, b, 1);
+        return;
+    }
+    old_energy = particleEnergy(x, y, num_particles, mutated, x[mutated], y[mutated], &hit);
+    new_energy = particleEnergy(x, y, num_particles, mutated, px, py, &hit);
+    x[mutated] = px;
+    y[mutated] = py;
+    if(hit) //moved on top of another particle
+        evalPopulation(pop, b, 1);
+    else
+        (*pop).fitness[b] += new_energy - old_energy;
+}
+
+// grid steps of a local search move, to one of the 8 neighbouring points
+static const int step_x[8] = {1, 1, 0, -1, -1, -1, 0, 1};
+static const int step_y[8] = {0, 1, 1, 1, 0, -1, -1, -1};
+
+/* memetic refinement of box b - try local_moves_option moves of a random particle to a neighbouring
+ * grid point and keep those that raise the fitness, each scored from that particle's interactions only, O(N) */
+void localSearch(box_population *pop, int b, int x_max, int y_max, rng_state *r)
+{
+    int m, hit;
+    double old_energy, new_energy;
+    int num_particles = (*pop).num_particles;
+    coord_t *x = BOX_X(pop,b);
+    coord_t *y = BOX_Y(pop,b);
+    if((*pop).overlap[b])
+        return; //no pair sum to climb, mutation has to move it apart
+    for(m = 0; m < local_moves_option; m++)
+    {
+        int moved = rngInt(r, num_particles);
+        int step = rngInt(r, 8);
+        int px = x[moved] + step_x[step];
+        int py = y[moved] + step_y[step];
+        if(px < 0 || px > x_max || py < 0 || py > y_max)
+            continue; //off the grid
+        old_energy = particleEnergy(x, y, num_particles, moved, x[moved], y[moved], &hit);
+        new_energy = particleEnergy(x, y, num_particles, moved, px, py, &hit);
+        if(!hit && new_energy > old_energy)
+        {
+            x[moved] = px;
+            y[moved] = py;
+            (*pop).fitness[b] += new_energy - old_energy;
+        }
+    }
+}
+
+// fitness and index of one box, for the argmin/argmax reductions in breeding
+typedef struct
+{
+    double fitness;
+    int index;
+} box_rank;
+
+/* fitter of two boxes, ties go to the lower index so the result is independent of thread count */
+static inline box_rank fitter(box_rank a, box_rank b)
+{
+    return (b.fitness > a.fitness || (b.fitness == a.fitness && b.index < a.index)) ? b : a;
+}
+
+/* weaker of two boxes, ties go to the lower index */
+static inline box_rank weaker(box_rank a, box_rank b)
+{
+    return (b.fitness < a.fitness || (b.fitness == a.fitness && b.index < a.index)) ? b : a;
+}
+
+#pragma omp declare reduction(fittest : box_rank : omp_out = fitter(omp_out, omp_in)) initializer(omp_priv = (box_rank){-INFINITY, INT_MAX})
+#pragma omp declare reduction(weakest : box_rank : omp_out = weaker(omp_out, omp_in)) initializer(omp_priv = (box_rank){INFINITY, INT_MAX})
+
+/* Main GA function - does selection, breeding, crossover and mutation
+ * breeds box into new_generation, the caller swaps the two buffers afterwards
+ * called by every thread of a team, which share the work - two barriers per generation */
+int breeding(box_population *box, box_population *new_generation, int x_max, int y_max)
+{
+        int population_size = (*box).size;
+        int num_particles = (*box).num_particles;
+        int i;
+        //highest from previous generation, fittest and weakest new box - each thread
+        //tracks its own and the reductions merge them, no locks needed
+        //static, as reduction targets and the result have to be shared by the team
+        static box_rank best_parent = {-INFINITY, INT_MAX};
+        static box_rank best_child = {-INFINITY, INT_MAX};
+        static box_rank worst_child = {INFINITY, INT_MAX};
+        static int highest;
+
+        {
+            rng_state *r = &rng[omp_get_thread_num()]; //this thread's own stream
+            phase_timer *t = threadTimer();
+            int first = population_size, last = 0; //children this thread breeds, one contiguous block
+            beginGeneration(t);
+            #pragma omp for schedule(static) nowait
+            for (i = 0; i < population_size; i += 2)
+            {   //two children
+                first = i < first ? i : first;
+                last = i + 2;
+                // Determine breeding pair, with tournament of 2 (joust)
+                int one, two, splitPoint, parentOne, parentTwo;
+                enterPhase(t, PHASE_SELECTION);
+                do
+                {
+                    one = rngInt(r, population_size);
+                    do
+                    {
+                        two = rngInt(r, population_size);
+                    } while(one == two);
+                    parentOne = two;
+                    if((*box).fitness[one] > (*box).fitness[two])
+                        parentOne = one; //joust
+                
+                    one = rngInt(r, population_size);
+                    do
+                    {
+                        two = rngInt(r, population_size);
+                    } while(one == two);
+                    parentTwo = two;
+                    if((*box).fitness[one] > (*box).fitness[two])
+                        parentTwo = one; //joust
+                } while(parentOne == parentTwo);
+            
+                do
+                {
+                    splitPoint = rngInt(r, num_particles); //split chromosome at point
+                } while(splitPoint == 0 || splitPoint == num_particles - 1);
+                enterPhase(t, PHASE_CROSSOVER);
+                crossover(new_generation, i, box, parentOne, parentTwo, splitPoint, r); //first child
+                crossover(new_generation, i+1, box, parentTwo, parentOne, splitPoint, r); //second child
+                chargePhase(t, PHASE_OTHER); //loop control
+            }
+            if(last > first)
+                evalPopulation(new_generation, first, last - first); //this thread's children in one batch
+
+            //the same static schedule over the same pairs, so every thread gets back the children it
+            //bred and evaluated, and the loop above needs no barrier
+            #pragma omp for schedule(static) reduction(fittest:best_parent,best_child) reduction(weakest:worst_child)
+            for (i = 0; i < population_size; i += 2)
+            {
+                // Mutation first child
+                enterPhase(t, PHASE_MUTATION);
+                double mutation = rngDouble(r);
+                if(mutation <= MUTATION_RATE)
+                    mutate(new_generation, i, x_max, y_max, r);
+                mutation = rngDouble(r); //mutation second child
+                if(mutation <= MUTATION_RATE)
+                    mutate(new_generation, i+1, x_max, y_max, r);
+
+                if(local_moves_option > 0) //memetic stage, climb to a nearby local optimum
+                {
+                    enterPhase(t, PHASE_LOCAL);
+                    localSearch(new_generation, i, x_max, y_max, r);
+                    localSearch(new_generation, i+1, x_max, y_max, r);
+                }
+
+                //find maximum parent fitness to keep and minimum new generation to throw away
+                enterPhase(t, PHASE_ELITISM);
+                best_parent = fitter(best_parent, (box_rank){(*box).fitness[i], i});
+                best_parent = fitter(best_parent, (box_rank){(*box).fitness[i+1], i+1});
+                best_child = fitter(best_child, (box_rank){(*new_generation).fitness[i], i});
+                best_child = fitter(best_child, (box_rank){(*new_generation).fitness[i+1], i+1});
+                worst_child = weaker(worst_child, (box_rank){(*new_generation).fitness[i], i});
+                worst_child = weaker(worst_child, (box_rank){(*new_generation).fitness[i+1], i+1});
+                chargePhase(t, PHASE_OTHER); //loop control and waiting at the barrier
+            }
+        }
+
+        #pragma omp single
+        {   //the other threads wait here until the new generation is complete
+            phase_timer *t = threadTimer();
+            enterPhase(t, PHASE_ELITISM);
+            int max_parent = best_parent.index;
+            int min_box = worst_child.index;
+            double max_fitness = best_child.fitness;
+            highest = best_child.index;
+            // printf("max fitness should be: %f\n",(*box).fitness[max_parent]);
+            //the only copy - best parent over the weakest child
+            copybox(new_generation, min_box, box, max_parent);
+            if((*box).fitness[max_parent] > max_fitness)
+            {   //previous generation has the best
+                max_fitness=(*box).fitness[max_parent];
+                highest=min_box;
+                //printf("max fitness should be: %f",(*box).fitness[max_parent]);
+            }
+            //ready for the next generation, nobody else reads these until then
+            best_parent = (box_rank){-INFINITY, INT_MAX};
+            best_child = (box_rank){-INFINITY, INT_MAX};
+            worst_child = (box_rank){INFINITY, INT_MAX};
+            chargePhase(t, PHASE_OTHER);
+        }
+        endGeneration(threadTimer());
+        return highest;
+}
+
+/* one generation, bred by a thread team of this island
+ * the team is forked between migrations, which only the master thread takes part in */
+int breedTeam(box_population *box, box_population *new_generation, int x_max, int y_max)
+{
+    int highest;
+    #pragma omp parallel
+    {
+        int best = breeding(box, new_generation, x_max, y_max);
+        #pragma omp master
+        highest = best;
+    }
+    return highest;
+}
+
+/* box locks and per-thread child buffers of the steady-state mode, for a population of size boxes */
+void initSteady(int size, int num_particles)
+{
+    int i;
+    box_locks = malloc(size*sizeof(omp_lock_t));
+    for(i = 0; i < size; i++)
+        omp_init_lock(&box_locks[i]);
+    steady_children = malloc(omp_get_max_threads()*sizeof(box_population));
+    for(i = 0; i < omp_get_max_threads(); i++)
+        allocPopulation(&steady_children[i], 2, num_particles);
+}
+
+/* release what initSteady set up for size boxes */
+void freeSteady(int size)
+{
+    int i;
+    for(i = 0; i < size; i++)
+        omp_destroy_lock(&box_locks[i]);
+    free(box_locks);
+    for(i = 0; i < omp_get_max_threads(); i++)
+        freePopulation(&steady_children[i]);
+    free(steady_children);
+}
+
+/* one steady-state step - two jousts between four different boxes pick the parents and their children
+ * replace the two losers in place, so the population is never copied
+ * the four boxes are locked while the step uses them, steps of other threads carry on around them
+ * returns the fitter child where it now lives */
+box_rank steadyStep(box_population *pop, int x_max, int y_max, rng_state *r)
+{
+    phase_timer *t = threadTimer();
+    box_population *children = &steady_children[omp_get_thread_num()];
+    int population_size = (*pop).size;
+    int num_particles = (*pop).num_particles;
+    int picked[4], order[4];
+    int i, j, splitPoint, parentOne, parentTwo, loserOne, loserTwo;
+    box_rank child;
+    enterPhase(t, PHASE_SELECTION);
+    for(i = 0; i < 4; i++)
+    {
+        do
+        {
+            picked[i] = rngInt(r, population_size);
+            for(j = 0; j < i && picked[j] != picked[i]; j++);
+        } while(j < i); //drawn already
+    }
+    //lock in index order, so steps sharing boxes can never deadlock
+    for(i = 0; i < 4; i++)
+    {
+        for(j = i; j > 0 && order[j - 1] > picked[i]; j--)
+            order[j] = order[j - 1];
+        order[j] = picked[i];
+    }
+    for(i = 0; i < 4; i++)
+        omp_set_lock(&box_locks[order[i]]);
+    parentOne = picked[1]; //joust
+    loserOne = picked[0];
+    if((*pop).fitness[picked[0]] > (*pop).fitness[picked[1]])
+    {
+        parentOne = picked[0];
+        loserOne = picked[1];
+    }
+    parentTwo = picked[3]; //joust
+    loserTwo = picked[2];
+    if((*pop).fitness[picked[2]] > (*pop).fitness[picked[3]])
+    {
+        parentTwo = picked[2];
+        loserTwo = picked[3];
+    }
+    do
+    {
+        splitPoint = rngInt(r, num_particles); //split chromosome at point
+    } while(splitPoint == 0 || splitPoint == num_particles - 1);
+
+    enterPhase(t, PHASE_CROSSOVER);
+    crossover(children, 0, pop, parentOne, parentTwo, splitPoint, r);
+    crossover(children, 1, pop, parentTwo, parentOne, splitPoint, r);
+    omp_unset_lock(&box_locks[parentOne]); //parents are only read
+    omp_unset_lock(&box_locks[parentTwo]);
+    evalPopulation(children, 0, 2);
+
+    enterPhase(t, PHASE_MUTATION);
+    if(rngDouble(r) <= MUTATION_RATE)
+        mutate(children, 0, x_max, y_max, r);
+    if(rngDouble(r) <= MUTATION_RATE)
+        mutate(children, 1, x_max, y_max, r);
+    if(local_moves_option > 0)
+    {
+        enterPhase(t, PHASE_LOCAL);
+        localSearch(children, 0, x_max, y_max, r);
+        localSearch(children, 1, x_max, y_max, r);
+    }
+
+    enterPhase(t, PHASE_ELITISM); //replacement
+    copybox(pop, loserOne, children, 0);
+    copybox(pop, loserTwo, children, 1);
+    child = fitter((box_rank){(*pop).fitness[loserOne], loserOne}, (box_rank){(*pop).fitness[loserTwo], loserTwo});
+    omp_unset_lock(&box_locks[loserOne]);
+    omp_unset_lock(&box_locks[loserTwo]);
+    chargePhase(t, PHASE_OTHER);
+    return child;
+}
+
+/* steady-state counterpart of breedTeam - as many steps as breeding makes pairs of children, shared out
+ * to a new team and made in place, the team only joins so that the master can talk to the other islands
+ * returns the fittest box */
+int steadyTeam(box_population *box, int x_max, int y_max)
+{
+    int i;
+    box_rank fittest = {-INFINITY, INT_MAX};
+    #pragma omp parallel
+    {
+        phase_timer *t = threadTimer();
+        rng_state *r = &rng[omp_get_thread_num()];
+        beginGeneration(t);
+        #pragma omp for schedule(static) nowait
+        for(i = 0; i < (*box).size/2; i++)
+            steadyStep(box, x_max, y_max, r);
+        endGeneration(t);
+    }
+    for(i = 0; i < (*box).size; i++)
+        fittest = fitter(fittest, (box_rank){(*box).fitness[i], i});
+    return fittest.index;
+}
+
+/* derived datatype covering boxes start..start+count-1 of a population in place
+ * the boxes are contiguous in each array of the arena, so this is four blocks addressed from MPI_BOTTOM
+ * and migrants go straight between population memory and the wire, the caller frees the type */
+MPI_Datatype boxesType(int start, int count, box_population *data)
+{
+    MPI_Datatype type;
+    int num_coords = count*(*data).num_particles;
+    int lengths[4] = {num_coords, num_coords, count, count};
+    MPI_Aint displacements[4];
+    MPI_Datatype types[4] = {MPI_COORD, MPI_COORD, MPI_DOUBLE, MPI_INT};
+    MPI_Get_address(BOX_X(data,start), &displacements[0]);
+    MPI_Get_address(BOX_Y(data,start), &displacements[1]);
+    MPI_Get_address(&(*data).fitness[start], &displacements[2]);
+    MPI_Get_address(&(*data).overlap[start], &displacements[3]);
+    MPI_Type_create_struct(4, lengths, displacements, types, &type);
+    MPI_Type_commit(&type);
+    return type;
+}
+
+/* send boxes start..start+count-1 of data to dest */
+void send_boxes(int start, int count, box_population* data, int dest, int tag, MPI_Comm comm)
+{
+    MPI_Datatype type = boxesType(start, count, data);
+    MPI_Send(MPI_BOTTOM, 1, type, dest, tag, comm);
+    MPI_Type_free(&type);
+}
+
+/* receive count boxes from src into data, starting at box start */
+void recv_boxes(int start, int count, box_population* data, int src, int tag, MPI_Comm comm)
+{
+    MPI_Datatype type = boxesType(start, count, data);
+    MPI_Recv(MPI_BOTTOM, 1, type, src, tag, comm, MPI_STATUS_IGNORE);
+    MPI_Type_free(&type);
+}
+
+/* start sending boxes start..start+count-1 of data to dest, they must stay untouched until the request completes */
+void isend_boxes(int start, int count, box_population* data, int dest, int tag, MPI_Comm comm, MPI_Request *request)
+{
+    MPI_Datatype type = boxesType(start, count, data);
+    MPI_Isend(MPI_BOTTOM, 1, type, dest, tag, comm, request);
+    MPI_Type_free(&type); //only marked for release while the send is pending
+}
+
+/* start receiving count boxes from src into data, starting at box start */
+void irecv_boxes(int start, int count, box_population* data, int src, int tag, MPI_Comm comm, MPI_Request *request)
+{
+    MPI_Datatype type = boxesType(start, count, data);
+    MPI_Irecv(MPI_BOTTOM, 1, type, src, tag, comm, request);
+    MPI_Type_free(&type);
+}
+
+/* set up the communicator and fixed links of a migration topology on MPI_COMM_WORLD
+ * pair and hypercube links change with every exchange, see migrationLinks */
+void initTopology(migration_topology *t, int topology, int degree)
+{
+    int rank, size, i;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    if(topology == TOPOLOGY_HYPERCUBE && (size & (size - 1)) != 0)
+    {
+        if(rank == 0)
+            printf("A hypercube needs a power of two islands, using a ring\n");
+        topology = TOPOLOGY_RING;
+    }
+    (*t).topology = topology;
+    (*t).max_links = topology == TOPOLOGY_TORUS ? 2 : 1;
+    if(topology == TOPOLOGY_RANDOM)
+    {   //each island picks its own destinations, the graph tells it who sends to it
+        int weighted, *picks = malloc(size*sizeof(int));
+        int *weights = malloc(2*size*sizeof(int)); //all links count the same
+        for(i = 0; i < 2*size; i++)
+            weights[i] = 1;
+        degree = degree < size - 1 ? degree : size - 1;
+        for(i = 0; i < size; i++)
+            picks[i] = i;
+        picks[rank] = picks[size - 1]; //never itself
+        for(i = 0; i < degree; i++)
+        {   //partial Fisher-Yates over the other islands
+            int j = i + rngInt(&rng[0], size - 1 - i);
+            int swap = picks[i];
+            picks[i] = picks[j];
+            picks[j] = swap;
+        }
+        MPI_Dist_graph_create(MPI_COMM_WORLD, 1, &rank, &degree, picks, weights, MPI_INFO_NULL, 0, &(*t).comm);
+        free(picks);
+        MPI_Dist_graph_neighbors_count((*t).comm, &(*t).num_sources, &(*t).num_destinations, &weighted);
+        (*t).max_links = (*t).num_sources > (*t).num_destinations ? (*t).num_sources : (*t).num_destinations;
+        (*t).max_links = (*t).max_links > 1 ? (*t).max_links : 1;
+        (*t).sources = malloc((*t).max_links*sizeof(int));
+        (*t).destinations = malloc((*t).max_links*sizeof(int));
+        MPI_Dist_graph_neighbors((*t).comm, (*t).num_sources, (*t).sources, weights, (*t).num_destinations, (*t).destinations, weights + size);
+        free(weights);
+        return;
+    }
+    (*t).sources = malloc((*t).max_links*sizeof(int));
+    (*t).destinations = malloc((*t).max_links*sizeof(int));
+    (*t).num_sources = (*t).num_destinations = 0;
+    if(topology == TOPOLOGY_PAIR)
+        MPI_Comm_dup(MPI_COMM_WORLD, &(*t).comm);
+    else
+    {   //ring is one periodic dimension, torus two, and a hypercube one dimension of two islands per bit
+        int dims[32] = {0}, periods[32];
+        int ndims = topology == TOPOLOGY_TORUS ? 2 : 1;
+        if(topology == TOPOLOGY_HYPERCUBE)
+        {
+            for(ndims = 0; (1 << ndims) < size; ndims++)
+                dims[ndims] = 2;
+            if(ndims == 0) //a single island
+                dims[ndims++] = 1;
+        }
+        else
+            MPI_Dims_create(size, ndims, dims);
+        for(i = 0; i < ndims; i++)
+            periods[i] = 1;
+        MPI_Cart_create(MPI_COMM_WORLD, ndims, dims, periods, 0, &(*t).comm);
+        (*t).dimensions = ndims;
+        if(topology != TOPOLOGY_HYPERCUBE)
+            for(i = 0; i < ndims; i++)
+            {   //emigrants go one step up each dimension, immigrants come from one step down
+                int source, destination;
+                MPI_Cart_shift((*t).comm, i, 1, &source, &destination);
+                if(destination != rank)
+                    (*t).destinations[(*t).num_destinations++] = destination;
+                if(source != rank)
+                    (*t).sources[(*t).num_sources++] = source;
+            }
+    }
+}
+
+/* links of exchange number exchange_count, for the topologies whose links change */
+void migrationLinks(migration_topology *t, int exchange_count)
+{
+    int rank, size, partner;
+    MPI_Comm_rank((*t).comm, &rank);
+    MPI_Comm_size((*t).comm, &size);
+    if((*t).topology == TOPOLOGY_PAIR)
+    {   //neighbouring even and odd islands, shifted by one on every other exchange
+        if(exchange_count%2==0) //even number of exchanges
+        {
+            if(rank%2==0) //even rank
+            {
+                if(rank==(size-1))
+                    partner = rank;
+                else
+                    partner = rank+1;
+            }
+            else //odd rank
+                partner = rank-1;
+        }
+        else //odd number of exchanges
+        {
+            if(rank%2==0) //even rank
+            {
+                if(rank==0 && size%2!=0)
+                    partner = rank;
+                else
+                    partner = (rank+size-1)%size;
+            }
+            else //odd rank
+                partner = (rank+1)%size;
+        }
+    }
+    else if((*t).topology == TOPOLOGY_HYPERCUBE)
+    {   //one dimension at a time, each of size 2 and periodic, so both neighbours are the partner
+        int source;
+        MPI_Cart_shift((*t).comm, exchange_count%(*t).dimensions, 1, &source, &partner);
+    }
+    else
+        return;
+    (*t).num_sources = (*t).num_destinations = partner != rank;
+    (*t).sources[0] = (*t).destinations[0] = partner;
+}
+
+/* release a migration topology */
+void freeTopology(migration_topology *t)
+{
+    free((*t).sources);
+    free((*t).destinations);
+    MPI_Comm_free(&(*t).comm);
+}
+
+// fitness the comparator of chooseBoxes ranks by
+static const double *order_fitness;
+
+/* fitter box first, ties by index */
+int fitterFirst(const void *a, const void *b)
+{
+    int i = *(const int*)a, j = *(const int*)b;
+    if(order_fitness[i] != order_fitness[j])
+        return order_fitness[i] > order_fitness[j] ? -1 : 1;
+    return i - j;
+}
+
+/* pick count distinct boxes of pop by policy into chosen, which has room for the whole population */
+void chooseBoxes(box_population *pop, int count, int policy, int *chosen)
+{
+    int i, size = (*pop).size;
+    for(i = 0; i < size; i++)
+        chosen[i] = i;
+    if(policy == POLICY_BEST || policy == POLICY_WORST)
+    {
+        order_fitness = (*pop).fitness;
+        qsort(chosen, size, sizeof(int), fitterFirst);
+        if(policy == POLICY_WORST)
+            for(i = 0; i < count; i++)
+                chosen[i] = chosen[size - 1 - i]; //the weakest sit at the end
+    }
+    else if(policy == POLICY_RANDOM)
+        for(i = 0; i < count; i++)
+        {   //partial Fisher-Yates
+            int j = i + rngInt(&rng[0], size - i);
+            int swap = chosen[i];
+            chosen[i] = chosen[j];
+            chosen[j] = swap;
+        }
+}
+
+/* merge block b of the immigrants into pop, over the boxes picked by the replacement policy */
+void immigrate(box_population *pop, box_population *immigrants, int b, int count, int *chosen)
+{
+    int i;
+    chooseBoxes(pop, count, replace_option, chosen);
+    for(i = 0; i < count; i++)
+        copybox(pop, chosen[i], immigrants, b*count + i);
+}
+
+/* allocate a board of count boxes per island, collective over MPI_COMM_WORLD */
+void initBoard(migration_board *b, int count, int num_particles)
+{
+    int size;
+    MPI_Aint coords = alignArena((size_t)count*num_particles*sizeof(coord_t));
+    MPI_Aint fitness = alignArena((size_t)count*sizeof(double));
+    int num_coords = count*num_particles;
+    int lengths[4] = {num_coords, num_coords, count, count};
+    MPI_Aint displacements[4];
+    MPI_Datatype types[4] = {MPI_COORD, MPI_COORD, MPI_DOUBLE, MPI_INT};
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    (*b).header = alignArena(sizeof(long) + sizeof(double));
+    displacements[0] = (*b).header; //same layout as a population arena
+    displacements[1] = (*b).header + coords;
+    displacements[2] = (*b).header + 2*coords;
+    displacements[3] = (*b).header + 2*coords + fitness;
+    MPI_Type_create_struct(4, lengths, displacements, types, &(*b).boxes_type);
+    MPI_Type_commit(&(*b).boxes_type);
+    MPI_Win_allocate(displacements[3] + alignArena((size_t)count*sizeof(int)), 1, MPI_INFO_NULL, MPI_COMM_WORLD, &(*b).slot, &(*b).win);
+    (*b).count = count;
+    (*b).seen = malloc(size*sizeof(long));
+}
+
+/* empty the board for a new iteration, collective so that no island reads the last one */
+void resetBoard(migration_board *b)
+{
+    int rank, size, i;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    MPI_Win_lock(MPI_LOCK_EXCLUSIVE, rank, 0, (*b).win);
+    *(long*)(*b).slot = 0; //nothing published
+    MPI_Win_unlock(rank, (*b).win);
+    (*b).version = 0;
+    for(i = 0; i < size; i++)
+        (*b).seen[i] = 0;
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+/* put the emigrants in this island's slot, readers never see half of them */
+void publishBoard(migration_board *b, box_population *emigrants)
+{
+    int rank, i;
+    double best = -INFINITY;
+    MPI_Datatype type = boxesType(0, (*b).count, emigrants);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    for(i = 0; i < (*b).count; i++)
+        best = fmax(best, (*emigrants).fitness[i]);
+    (*b).version += 1;
+    MPI_Win_lock(MPI_LOCK_EXCLUSIVE, rank, 0, (*b).win);
+    MPI_Put(MPI_BOTTOM, 1, type, rank, 0, 1, (*b).boxes_type, (*b).win);
+    MPI_Put(&(*b).version, 1, MPI_LONG, rank, 0, 1, MPI_LONG, (*b).win);
+    MPI_Put(&best, 1, MPI_DOUBLE, rank, sizeof(long), 1, MPI_DOUBLE, (*b).win);
+    MPI_Win_unlock(rank, (*b).win);
+    MPI_Type_free(&type);
+}
+
+/* get the boxes island src published into block 0 of immigrants
+ * returns 0 if it has published nothing new since the last pull */
+int pullBoard(migration_board *b, int src, box_population *immigrants)
+{
+    long version;
+    int pulled;
+    MPI_Win_lock(MPI_LOCK_SHARED, src, 0, (*b).win);
+    MPI_Get(&version, 1, MPI_LONG, src, 0, 1, MPI_LONG, (*b).win);
+    MPI_Win_flush(src, (*b).win);
+    pulled = version > (*b).seen[src];
+    if(pulled)
+    {
+        MPI_Datatype type = boxesType(0, (*b).count, immigrants);
+        MPI_Get(MPI_BOTTOM, 1, type, src, 0, 1, (*b).boxes_type, (*b).win);
+        MPI_Type_free(&type);
+        (*b).seen[src] = version;
+    }
+    MPI_Win_unlock(src, (*b).win);
+    return pulled;
+}
+
+/* island that has published the fittest box so far, -1 if none has, its fitness in *best */
+int boardBest(migration_board *b, double *best)
+{
+    int size, i, island = -1;
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    long *versions = malloc(size*sizeof(long));
+    double *bests = malloc(size*sizeof(double));
+    MPI_Win_lock_all(0, (*b).win); //a version and a fitness from every slot
+    for(i = 0; i < size; i++)
+    {
+        MPI_Get(&versions[i], 1, MPI_LONG, i, 0, 1, MPI_LONG, (*b).win);
+        MPI_Get(&bests[i], 1, MPI_DOUBLE, i, sizeof(long), 1, MPI_DOUBLE, (*b).win);
+    }
+    MPI_Win_unlock_all((*b).win);
+    for(i = 0; i < size; i++)
+        if(versions[i] > 0 && (island < 0 || bests[i] > *best))
+        {
+            island = i;
+            *best = bests[i];
+        }
+    free(versions);
+    free(bests);
+    return island;
+}
+
+/* release a board, collective */
+void freeBoard(migration_board *b)
+{
+    MPI_Win_free(&(*b).win);
+    MPI_Type_free(&(*b).boxes_type);
+    free((*b).seen);
+}
+
+/* share population_size boxes out between islands in pairs, in proportion to weight or evenly if it is NULL
+ * every island gets at least MIN_ISLAND boxes, the pairs left over by rounding go to the islands furthest below their share */
+void splitPopulation(int population_size, int islands, const double *weight, int *island_sizes)
+{
+    int i, pairs = population_size/2 - islands*(MIN_ISLAND/2); //pairs beyond the minimum
+    int spare = pairs;
+    double total = 0.0;
+    for(i = 0; i < islands; i++)
+        total += weight ? weight[i] : 1.0;
+    for(i = 0; i < islands; i++)
+    {
+        island_sizes[i] = (int)(pairs*(weight ? weight[i] : 1.0)/total);
+        spare -= island_sizes[i];
+    }
+    while(spare != 0)
+    {   //lowest index on ties, so every rank would get the same split
+        int pick = -1;
+        double pick_gap = 0.0;
+        for(i = 0; i < islands; i++)
+        {
+            double gap = pairs*(weight ? weight[i] : 1.0)/total - island_sizes[i];
+            if(spare < 0 && island_sizes[i] == 0)
+                continue; //rounded up too far, only take back pairs that are there
+            if(pick < 0 || (spare > 0 ? gap > pick_gap : gap < pick_gap))
+            {
+                pick = i;
+                pick_gap = gap;
+            }
+        }
+        island_sizes[pick] += spare > 0 ? 1 : -1;
+        spare += spare > 0 ? -1 : 1;
+    }
+    for(i = 0; i < islands; i++)
+        island_sizes[i] = 2*island_sizes[i] + MIN_ISLAND; //pairs to boxes
+}
+
+/* look up an option value in a list of names, -1 if it is not there */
+int optionIndex(const char *value, const char **names, int count)
+{
+    int i;
+    for(i = 0; i < count; i++)
+        if(strcmp(value, names[i]) == 0)
+            return i;
+    return -1;
+}
+
+/* bytes of one island's part of a checkpoint */
+size_t islandCheckpointSize(int size, int num_particles)
+{
+    return sizeof(island_checkpoint) + checkpoint.header.num_streams*sizeof(rng[0].s) + (size_t)size*(2*num_particles*sizeof(coord_t) + sizeof(double) + sizeof(int));
+}
+
+/* where island i's part of a checkpoint starts, after the header, the island sizes and the islands before it */
+MPI_Offset islandOffset(int *island_sizes, int i)
+{
+    MPI_Offset offset = sizeof(checkpoint_header) + checkpoint.header.islands*sizeof(int);
+    int j;
+    for(j = 0; j < i; j++)
+        offset += islandCheckpointSize(island_sizes[j], checkpoint.header.num_particles);
+    return offset;
+}
+
+/* set when a checkpoint header belongs to the same build and problem as this run */
+int sameRun(const checkpoint_header *a, const checkpoint_header *b)
+{
+    return memcmp((*a).magic, (*b).magic, sizeof((*a).magic)) == 0 && (*a).coord_bits == (*b).coord_bits
+        && (*a).population_size == (*b).population_size && (*a).x_max == (*b).x_max && (*a).y_max == (*b).y_max
+        && (*a).num_particles == (*b).num_particles && (*a).iter == (*b).iter
+        && (*a).islands == (*b).islands && (*a).num_streams == (*b).num_streams;
+}
+
+/* wait for the snapshot being written, collective
+ * the temporary file then replaces the checkpoint, so a run killed while writing still leaves the previous one */
+void finishCheckpoint(void)
+{
+    char temp[256];
+    int rank;
+    if(!checkpoint.writing)
+        return;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Wait(&checkpoint.write, MPI_STATUS_IGNORE);
+    MPI_File_sync(checkpoint.file); //on disk before it replaces the last checkpoint
+    MPI_File_close(&checkpoint.file);
+    snprintf(temp, sizeof(temp), "%s.tmp", checkpoint.name);
+    if(rank == 0 && rename(temp, checkpoint.name) != 0)
+        printf("Error writing checkpoint %s\n", checkpoint.name);
+    MPI_Barrier(MPI_COMM_WORLD); //nobody opens the temporary file again before it has been renamed
+    checkpoint.writing = 0;
+}
+
+/* snapshot this island and start writing it to the checkpoint file, collective
+ * main fills in checkpoint.header and checkpoint.island, the generators and population are copied here
+ * the last snapshot is finished first, which by then has normally long been written */
+void saveCheckpoint(box_population *pop, int *island_sizes)
+{
+    char temp[256];
+    int rank, t;
+    size_t coords = (size_t)(*pop).size*(*pop).num_particles*sizeof(coord_t);
+    size_t header = sizeof(checkpoint_header) + checkpoint.header.islands*sizeof(int);
+    MPI_Offset offset;
+    char *p;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    finishCheckpoint();
+    offset = islandOffset(island_sizes, rank);
+    checkpoint.buffer = realloc(checkpoint.buffer, header + islandCheckpointSize((*pop).size, (*pop).num_particles)); //islands change size with --rebalance
+    p = checkpoint.buffer;
+    if(rank == 0)
+    {   //the header and island sizes go in front of the first island
+        memcpy(p, &checkpoint.header, sizeof(checkpoint_header));
+        memcpy(p + sizeof(checkpoint_header), island_sizes, checkpoint.header.islands*sizeof(int));
+        p += header;
+        offset = 0;
+    }
+    memcpy(p, &checkpoint.island, sizeof(island_checkpoint));
+    p += sizeof(island_checkpoint);
+    for(t = 0; t < checkpoint.header.num_streams; t++, p += sizeof(rng[0].s))
+        memcpy(p, rng[t].s, sizeof(rng[t].s));
+    memcpy(p, (*pop).x, coords);
+    memcpy(p + coords, (*pop).y, coords);
+    p += 2*coords;
+    memcpy(p, (*pop).fitness, (*pop).size*sizeof(double));
+    p += (*pop).size*sizeof(double);
+    memcpy(p, (*pop).overlap, (*pop).size*sizeof(int));
+    checkpoint.bytes = p + (*pop).size*sizeof(int) - checkpoint.buffer;
+
+    snprintf(temp, sizeof(temp), "%s.tmp", checkpoint.name);
+    if(MPI_File_open(MPI_COMM_WORLD, temp, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &checkpoint.file) != MPI_SUCCESS)
+    {
+        if(rank == 0)
+            printf("Error opening checkpoint %s\n", temp);
+        return;
+    }
+    MPI_File_set_size(checkpoint.file, islandOffset(island_sizes, checkpoint.header.islands)); //drops the tail of a bigger earlier file
+    MPI_File_iwrite_at(checkpoint.file, offset, checkpoint.buffer, (int)checkpoint.bytes, MPI_BYTE, &checkpoint.write);
+    checkpoint.writing = 1;
+}
+
+/* open the checkpoint of an earlier, unfinished run of this problem and read its header and island sizes, collective
+ * returns 0 if there is none, one of another problem, build, number of islands or threads is an error
+ * the file is left open for loadIsland */
+int openCheckpoint(checkpoint_header *h, int *island_sizes)
+{
+    int rank, ok;
+    MPI_Offset bytes;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    if(MPI_File_open(MPI_COMM_WORLD, checkpoint.name, MPI_MODE_RDONLY, MPI_INFO_NULL, &checkpoint.file) != MPI_SUCCESS)
+        return 0;
+    MPI_File_get_size(checkpoint.file, &bytes);
+    ok = bytes >= (MPI_Offset)sizeof(*h) && MPI_File_read_at(checkpoint.file, 0, h, sizeof(*h), MPI_BYTE, MPI_STATUS_IGNORE) == MPI_SUCCESS
+        && sameRun(h, &checkpoint.header);
+    if(ok)
+    {
+        MPI_File_read_at(checkpoint.file, sizeof(*h), island_sizes, (*h).islands, MPI_INT, MPI_STATUS_IGNORE);
+        ok = bytes == islandOffset(island_sizes, (*h).islands); //every island is all there
+    }
+    if(!ok)
+    {
+        if(rank == 0)
+            printf("%s is not a checkpoint of this run with this number of islands and threads\n", checkpoint.name);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    return 1;
+}
+
+/* restore this island's generators and pop from the checkpoint opened by openCheckpoint, collective */
+void loadIsland(island_checkpoint *island, box_population *pop, int *island_sizes)
+{
+    int rank, t;
+    size_t bytes = islandCheckpointSize((*pop).size, (*pop).num_particles);
+    size_t coords = (size_t)(*pop).size*(*pop).num_particles*sizeof(coord_t);
+    char *buffer = malloc(bytes), *p = buffer;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_File_read_at(checkpoint.file, islandOffset(island_sizes, rank), buffer, (int)bytes, MPI_BYTE, MPI_STATUS_IGNORE);
+    MPI_File_close(&checkpoint.file);
+    memcpy(island, p, sizeof(*island));
+    p += sizeof(*island);
+    for(t = 0; t < checkpoint.header.num_streams; t++, p += sizeof(rng[0].s))
+        memcpy(rng[t].s, p, sizeof(rng[t].s));
+    memcpy((*pop).x, p, coords);
+    memcpy((*pop).y, p + coords, coords);
+    p += 2*coords;
+    memcpy((*pop).fitness, p, (*pop).size*sizeof(double));
+    p += (*pop).size*sizeof(double);
+    memcpy((*pop).overlap, p, (*pop).size*sizeof(int));
+    free(buffer);
+}
+
+/* take --name=value options out of argv, leaving the positional arguments in order
+ * returns the new argument count */
+int parseOptions(int argc, char *argv[])
+{
+    int i, n = 1;
+    for(i = 1; i < argc; i++)
+    {
+        if(strncmp(argv[i], "--", 2) != 0)
+            argv[n++] = argv[i]; //positional argument
+        else if(strncmp(argv[i], "--kernel=", 9) == 0)
+            kernel_option = argv[i] + 9;
+        else if(strncmp(argv[i], "--topology=", 11) == 0 && optionIndex(argv[i] + 11, topology_names, NUM_TOPOLOGIES) >= 0)
+            topology_option = optionIndex(argv[i] + 11, topology_names, NUM_TOPOLOGIES);
+        else if(strncmp(argv[i], "--seed=", 7) == 0)
+            seed_option = strtoull(argv[i] + 7, NULL, 10);
+#ifdef _OPENMP
+        else if(strncmp(argv[i], "--threads=", 10) == 0 && atoi(argv[i] + 10) > 0)
+            omp_set_num_threads(atoi(argv[i] + 10));
+#endif
+        else if(strncmp(argv[i], "--migration=", 12) == 0 && optionIndex(argv[i] + 12, migration_names, NUM_MIGRATIONS) >= 0)
+            migration_option = optionIndex(argv[i] + 12, migration_names, NUM_MIGRATIONS);
+        else if(strcmp(argv[i], "--rebalance") == 0)
+            rebalance_option = 1;
+        else if(strncmp(argv[i], "--degree=", 9) == 0 && atoi(argv[i] + 9) > 0)
+            degree_option = atoi(argv[i] + 9);
+        else if(strncmp(argv[i], "--emigrants=", 12) == 0 && optionIndex(argv[i] + 12, policy_names, NUM_POLICIES) >= 0)
+            emigrant_option = optionIndex(argv[i] + 12, policy_names, NUM_POLICIES);
+        else if(strncmp(argv[i], "--replace=", 10) == 0 && optionIndex(argv[i] + 10, policy_names, NUM_POLICIES) >= 0)
+            replace_option = optionIndex(argv[i] + 10, policy_names, NUM_POLICIES);
+        else if(strncmp(argv[i], "--cutoff=", 9) == 0 && atof(argv[i] + 9) >= 0)
+            cutoff_option = atof(argv[i] + 9);
+        else if(strcmp(argv[i], "--steady-state") == 0)
+            steady_state_option = 1;
+        else if(strncmp(argv[i], "--checkpoint=", 13) == 0 && atoi(argv[i] + 13) >= 0)
+            checkpoint_option = atoi(argv[i] + 13);
+        else if(strcmp(argv[i], "--resume") == 0)
+            resume_option = 1;
+        else if(strncmp(argv[i], "--cache=", 8) == 0 && atoi(argv[i] + 8) >= 0)
+            cache_option = atoi(argv[i] + 8);
+        else if(strncmp(argv[i], "--local-moves=", 14) == 0 && atoi(argv[i] + 14) >= 0)
+            local_moves_option = atoi(argv[i] + 14);
+        else if(strncmp(argv[i], "--patience=", 11) == 0 && atoi(argv[i] + 11) > 0)
+            patience_option = atoi(argv[i] + 11);
+        else if(strncmp(argv[i], "--min-improvement=", 18) == 0)
+            min_improvement_option = atof(argv[i] + 18);
+        else if(strncmp(argv[i], "--min-rel-improvement=", 22) == 0)
+            min_rel_improvement_option = atof(argv[i] + 22);
+        else
+        {
+            printf("Unknown option %s\n", argv[i]);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+    argv[n] = NULL;
+    return n;
+}
+
+int main(int argc, char *argv[])
+{
+    int rank, size;
+#ifdef _OPENMP
+    int provided; //threads breed, only the master thread talks to MPI
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+#else
+    MPI_Init(&argc, &argv);
+#endif
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    patience_option = TOLERANCE; //unless --patience is given
+    argc = parseOptions(argc, argv);
+#ifdef _OPENMP
+    if(rank == 0 && provided < MPI_THREAD_FUNNELED)
+        printf("Warning: MPI library does not support MPI_THREAD_FUNNELED\n");
+#endif
+
+    int population_size = DEFAULT_POP_SIZE;
+    int x_max = X_DEFAULT;
+    int y_max = Y_DEFAULT;
+    int num_particles = DEFAULT_NUM_PARTICLES;
+    int iter = ITERATIONS;
+    int k;
+
+    initRng(seed_option, rank*omp_get_max_threads(), omp_get_max_threads());
+    initTimers(omp_get_max_threads());
+
+    if(argc >= 2)
+    {
+        population_size = atoi(argv[1]); //size population first command line argument
+        if(argc >= 4)
+        {
+            x_max = atoi(argv[2]); //x dimension
+            y_max = atoi(argv[3]); //x dimension
+        }
+        if(argc >= 5)
+            num_particles = atoi(argv[4]);
+        if(argc >= 6)
+            iter = atoi(argv[5]);
+    }
+
+    if(population_size%2 != 0)
+    {
+        population_size += 1;
+        if(rank == 0)
+            printf("Population size rounded up to %d, boxes are bred in pairs\n", population_size);
+    }
+    if(population_size < size*MIN_ISLAND)
+    {
+        if(rank == 0)
+            printf("Population size %d is too small for %d islands of at least %d boxes\n", population_size, size, MIN_ISLAND);
+        MPI_Finalize();
+        return 1;
+    }
+    if(x_max > COORD_MAX || y_max > COORD_MAX)
+    {
+        if(rank == 0)
+            printf("A %dx%d box needs wider coordinates than %d bits, rebuild with a larger COORD_BITS\n", x_max, y_max, COORD_BITS);
+        MPI_Finalize();
+        return 1;
+    }
+    checkpoint_header *progress = &checkpoint.header; //what the next checkpoint records
+    memcpy((*progress).magic, CHECKPOINT_MAGIC, sizeof((*progress).magic));
+    (*progress).coord_bits = COORD_BITS;
+    (*progress).population_size = population_size;
+    (*progress).x_max = x_max;
+    (*progress).y_max = y_max;
+    (*progress).num_particles = num_particles;
+    (*progress).iter = iter;
+    (*progress).islands = size;
+    (*progress).num_streams = omp_get_max_threads();
+    checkpoint.name = "checkpoint_" OUTPUT_NAME ".bin";
+
+    int *island_sizes = malloc(size*sizeof(int)); //boxes on every island, always even
+    double *island_speeds = calloc(size, sizeof(double)); //boxes per second of every island, smoothed, on rank 0
+    splitPopulation(population_size, size, NULL, island_sizes);
+    checkpoint_header saved; //where a resumed run carries on from
+    island_checkpoint saved_island;
+    int resumed = resume_option && openCheckpoint(&saved, island_sizes); //islands keep the sizes --rebalance gave them
+    int subpopulation_size = island_sizes[rank];
+    int smallest_island = island_sizes[size-1]; //an even split puts the spare pairs on the first islands
+    for(int i = 0; i < size; i++) //but a rebalanced one need not
+        smallest_island = island_sizes[i] < smallest_island ? island_sizes[i] : smallest_island;
+    int exchange_amount = smallest_island/10; //the same on every island, so exchanges always match
+    int exchange_freq = MAX_GEN/100;
+    int tolerancecheck_freq = exchange_freq*5;
+
+    FILE *f = NULL;
+    FILE *results = NULL;
+    FILE *timing = NULL; //rank 0 writes the output files
+    FILE *convergence = NULL;
+    char run_name[200];
+    if(rank == 0)
+    {
+        printf("Using %d islands of %d threads, seed %llu\n", size, omp_get_max_threads(), (unsigned long long)seed_option);
+        printf("Starting optimization with particles = %d, population=%d, width=%d,length=%d for %d iterations\n", num_particles, population_size, x_max, y_max, iter);
+
+        char file_name[100];
+        sprintf(file_name, "solution_" OUTPUT_NAME "_%d_%d_%d_%d_%d.txt", population_size, x_max, y_max, num_particles, iter);
+        f = fopen(file_name, resumed ? "a" : "w"); //a resumed run adds to the solutions it already found
+        sprintf(run_name, "%.100s_%d_%d_%d_%d_%d", argv[0], population_size, x_max, y_max, num_particles, iter);
+        results = fopen("results_" OUTPUT_NAME ".txt","a");
+        timing = openTiming("timing_" OUTPUT_NAME ".txt");
+        convergence = openConvergence("convergence_" OUTPUT_NAME ".txt");
+        if(!resumed)
+        {
+            fprintf(results, "%s\n", run_name);
+            printf("Writing dimensions to file\n");
+            fprintf(f, "%d,%d\n", x_max, y_max); //write box dimensions as first line of file
+            fflush(f); //a resumed run only appends
+            fflush(results);
+        }
+    }
+    int gen_count = 0;
+    long eval_count = 0;
+    long hit_count = 0;
+    double total_time = 0;
+    double total_fitness = 0;
+
+    box_population generations[2]; //current and next generation, swapped after breeding
+    box_population *population = &generations[0];
+    box_population *next_generation = &generations[1];
+    box_population emigrants, immigrants; //in flight while the island keeps breeding
+    migration_topology topology;
+    migration_board board; //with --migration=rma
+    MPI_Request *receives, *sends; //of immigrants and emigrants of the last exchange, one per link
+    int *chosen; //boxes picked by the emigrant and replacement policies
+
+    initEnergyTable(x_max, y_max);
+    initCache(cache_option);
+    selectKernel(kernel_option);
+    checkKernel(x_max, y_max, num_particles);
+    if(cutoff_option > 0)
+        initCells(cutoff_option, x_max, y_max, num_particles);
+    if(rank == 0)
+        printf("Using %s fitness kernel, %d-bit coordinates\n", kernel_name, COORD_BITS);
+    allocPopulation(population, subpopulation_size, num_particles); //allocate memory
+    allocPopulation(next_generation, subpopulation_size, num_particles);
+    if(steady_state_option)
+        initSteady(subpopulation_size, num_particles);
+    initTopology(&topology, topology_option, degree_option);
+    allocPopulation(&emigrants, exchange_amount, num_particles);
+    allocPopulation(&immigrants, topology.max_links*exchange_amount, num_particles); //a block per source
+    if(migration_option == MIGRATION_RMA)
+        initBoard(&board, exchange_amount, num_particles);
+    receives = malloc(topology.max_links*sizeof(MPI_Request));
+    sends = malloc(topology.max_links*sizeof(MPI_Request));
+    chosen = malloc(subpopulation_size*sizeof(int));
+    if(resumed)
+    {
+        loadIsland(&saved_island, population, island_sizes);
+        gen_count = saved.gen_count;
+        eval_count = saved_island.eval_count;
+        hit_count = saved_island.hit_count;
+        total_fitness = saved.total_fitness;
+        total_time = saved.total_time;
+        if(rank == 0)
+            printf("Resuming from %s, iteration %d, generation %d\n", checkpoint.name, saved.iteration, saved.generation);
+    }
+
+    if(rank == 0)
+    {
+        printf("Population size: %d, Island sizes: %d to %d, Maxrank: %d\n", population_size, smallest_island, island_sizes[0], size);
+        printf("Migration: %s over %s topology, %s emigrants replace %s boxes\n", migration_names[migration_option], topology_names[topology.topology], policy_names[emigrant_option], policy_names[replace_option]);
+    }
+    for(k = resumed ? saved.iteration : 0; k<iter; k++)
+    {   //k is number of times whole simulation is run
+        int resuming = resumed && k == saved.iteration && saved.generation > 0; //the islands were restored from the checkpoint
+        if(rank == 0)
+            printf("=========%d\n", k);
+        if(!resuming)
+        {   //populate with initial population for each process
+            printf("Initializing population for island %d\n", rank);
+            initPopulation(population, x_max, y_max, &rng[0]);
+            fitness_evals = 0; //only count evaluations made while breeding
+            cache_hits = 0;
+        }
+        if(migration_option == MIGRATION_RMA)
+            resetBoard(&board); //emigrants posted before a checkpoint are not in it
+        double max_fitness = 0;
+        // main loop
+        int stop = 0;
+        int gen = 0, highest = 0;
+        int max_tolerance = MAX_GEN*3/10; //for the average generations since an island last improved
+        convergence_monitor island, global; //best fitness of this island and of all of them, logged by rank 0
+        startMonitor(&island, NULL, run_name, k);
+        startMonitor(&global, convergence, run_name, k);
+        int exchange_count = 0;
+        int migrating = 0; //blocks of immigrants of the last exchange still to be merged
+        double breed_time = 0; //spent breeding on this island, for its time per generation
+        int link;
+        //termination check, posted without waiting and consumed a generation later
+        MPI_Request termination[2] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+        int island_tolerance, total_tolerance;
+        double island_best, global_best;
+        int check_gen = 0; //generation the check was posted in
+        for(link = 0; link < topology.max_links; link++)
+            receives[link] = sends[link] = MPI_REQUEST_NULL;
+
+        int last_checkpoint = 0; //generation of the last snapshot
+
+        double begin = 0;
+        if(rank==0)
+            begin = MPI_Wtime();
+        if(resuming)
+        {
+            gen = last_checkpoint = saved.generation;
+            highest = saved_island.highest;
+            island.best = saved_island.best;
+            island.best_gen = saved_island.best_gen;
+            global.best = saved.best;
+            global.best_gen = saved.best_gen;
+            exchange_count = saved.exchange_count;
+            breed_time = saved_island.breed_time;
+            fitness_evals = saved_island.fitness_evals;
+            cache_hits = saved_island.cache_hits;
+            if(rank == 0)
+                begin -= saved.elapsed;
+        }
+        (*progress).iteration = k;
+        (*progress).gen_count = gen_count;
+        (*progress).total_fitness = total_fitness;
+        (*progress).total_time = total_time;
+        int t;
+        for(t = 0; t < num_timers; t++)
+            resetTimer(&timers[t]);
+
+        while(gen < MAX_GEN)
+        {
+            if(termination[0] != MPI_REQUEST_NULL)
+            {   //the check posted last generation, every island reads the same result here and stops together
+                double allreduce_begin = wallTime();
+                MPI_Waitall(2, termination, MPI_STATUSES_IGNORE);
+                addPhase(threadTimer(), PHASE_ALLREDUCE, allreduce_begin);
+
+                double ave_tolerance = (double)total_tolerance/(double)size;
+                if(ave_tolerance > max_tolerance) //break if average greater than max
+                {
+                    if(rank==0)
+                        printf("STOPPING: Average tolerance (%f) is larger than max (%d)\n", ave_tolerance, max_tolerance);
+                    break;
+                }
+                updateMonitor(&global, check_gen, global_best);
+                if(converged(&global, check_gen)) //no island has found anything better in a while
+                {
+                    if(rank==0)
+                        printf("STOPPING: Best fitness (%f) has not improved for %d generations\n", global.best, check_gen - global.best_gen);
+                    break;
+                }
+            }
+
+            if(migrating) //merge immigrants as soon as they have arrived, breeding never waits for them
+            {
+                int arrived;
+                for(link = 0; link < topology.num_sources; link++)
+                    if(receives[link] != MPI_REQUEST_NULL)
+                    {
+                        MPI_Test(&receives[link], &arrived, MPI_STATUS_IGNORE);
+                        if(arrived)
+                        {
+                            double migration_begin = wallTime();
+                            immigrate(population, &immigrants, link, exchange_amount, chosen);
+                            migrating -= 1;
+                            addPhase(threadTimer(), PHASE_MIGRATION, migration_begin);
+                        }
+                    }
+                MPI_Testall(topology.max_links, sends, &arrived, MPI_STATUSES_IGNORE); //keeps the sends moving too
+            }
+
+            if(gen != 0 && gen%exchange_freq == 0) //check if it is time to migrate/exchange
+            {
+                double migration_begin = wallTime();
+                for(link = 0; link < topology.num_sources; link++)
+                    if(receives[link] != MPI_REQUEST_NULL)
+                    {   //the last exchange has to land before the next one goes out
+                        MPI_Wait(&receives[link], MPI_STATUS_IGNORE);
+                        immigrate(population, &immigrants, link, exchange_amount, chosen);
+                    }
+                MPI_Waitall(topology.max_links, sends, MPI_STATUSES_IGNORE); //emigrants can be overwritten again
+                if(checkpoint_option > 0 && gen - last_checkpoint >= checkpoint_option)
+                {   //no migrants are in flight and no termination check is pending, so the islands agree on the snapshot
+                    (*progress).generation = gen;
+                    (*progress).exchange_count = exchange_count;
+                    (*progress).best = global.best;
+                    (*progress).best_gen = global.best_gen;
+                    (*progress).elapsed = rank == 0 ? MPI_Wtime() - begin : 0;
+                    checkpoint.island = (island_checkpoint){subpopulation_size, highest, island.best, island.best_gen, breed_time, fitness_evals, cache_hits, eval_count, hit_count};
+                    saveCheckpoint(population, island_sizes);
+                    last_checkpoint = gen;
+                }
+
+                //printf("(Gen %d) Island %d is ready to exchange\n", gen, rank);
+                migrationLinks(&topology, exchange_count);
+                chooseBoxes(population, exchange_amount, emigrant_option, chosen);
+                for(link = 0; link < exchange_amount; link++)
+                    copybox(&emigrants, link, population, chosen[link]); //copy of individuals to exchange
+                if(migration_option == MIGRATION_RMA)
+                {   //publish, then pull whatever the sources have posted - no island waits for another
+                    double best_posted, best_here = -INFINITY;
+                    int best_island;
+                    publishBoard(&board, &emigrants);
+                    for(link = 0; link < topology.num_sources; link++)
+                        if(pullBoard(&board, topology.sources[link], &immigrants))
+                            immigrate(population, &immigrants, 0, exchange_amount, chosen);
+                    for(link = 0; link < subpopulation_size; link++)
+                        best_here = fmax(best_here, (*population).fitness[link]);
+                    best_island = boardBest(&board, &best_posted);
+                    if(best_island >= 0 && best_island != rank && best_posted > best_here && pullBoard(&board, best_island, &immigrants))
+                        immigrate(population, &immigrants, 0, exchange_amount, chosen); //the global best, as it beats everything here
+                }
+                else
+                {
+                    for(link = 0; link < topology.num_sources; link++)
+                        irecv_boxes(link*exchange_amount, exchange_amount, &immigrants, topology.sources[link], exchange_count+1, topology.comm, &receives[link]);
+                    for(link = 0; link < topology.num_destinations; link++)
+                        isend_boxes(0, exchange_amount, &emigrants, topology.destinations[link], exchange_count+1, topology.comm, &sends[link]);
+                    migrating = topology.num_sources;
+                }
+                exchange_count += 1;
+                addPhase(threadTimer(), PHASE_MIGRATION, migration_begin);
+            }
+
+            double breed_begin = wallTime();
+            int current_best;
+            if(steady_state_option)
+                current_best = steadyTeam(population, x_max, y_max); //in place
+            else
+            {
+                current_best = breedTeam(population, next_generation, x_max, y_max);
+                box_population *parents = population; //children become the current generation
+                population = next_generation;
+                next_generation = parents;
+            }
+            breed_time += wallTime() - breed_begin;
+            highest = current_best;
+            updateMonitor(&island, gen + 1, (*population).fitness[highest]);
+
+            if(gen != 0 && gen%tolerancecheck_freq == 0) //check if it is time to report/check tolerance
+            {   //summed tolerance and global best, breeding goes on while they are reduced
+                double allreduce_begin = wallTime();
+                check_gen = gen + 1;
+                island_tolerance = check_gen - island.best_gen;
+                island_best = island.best;
+                MPI_Iallreduce(&island_tolerance, &total_tolerance, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD, &termination[0]);
+                MPI_Iallreduce(&island_best, &global_best, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD, &termination[1]);
+                addPhase(threadTimer(), PHASE_ALLREDUCE, allreduce_begin);
+            }
+
+            gen += 1;
+        }
+        MPI_Waitall(2, termination, MPI_STATUSES_IGNORE); //a check posted in the last generation
+        //the last exchange arrives too late to breed with, complete it so nothing is left in flight
+        MPI_Waitall(topology.max_links, receives, MPI_STATUSES_IGNORE);
+        MPI_Waitall(topology.max_links, sends, MPI_STATUSES_IGNORE);
+
+        MPI_Barrier(MPI_COMM_WORLD);
+        int current = 0;
+        while(current < size)
+        {
+            if(rank==current)
+            {
+                printf("GA for thread %d:\n", rank);
+                printf("# generations = %d\n", gen);
+                printf("Fitness evaluations per generation = %f\n", (double)fitness_evals/(double)gen);
+                printf("Fitness cache = %ld hits, %ld misses\n", cache_hits, fitness_evals);
+                printf("Best solution:\n");
+                printbox(population, highest);
+                printf("\n");
+            }
+            current += 1;
+            MPI_Barrier(MPI_COMM_WORLD);
+        }
+
+        //find the highest fitness across all processes
+
+        struct // for MAXLOC reduction
+        {
+            double fitness;
+            int index;
+        } localmax, globalmax;
+
+        localmax.fitness = (*population).fitness[highest];
+        localmax.index = rank;
+        MPI_Allreduce(&localmax, &globalmax, 1, MPI_DOUBLE_INT, MPI_MAXLOC, MPI_COMM_WORLD);
+
+        box_population global_bestbox;
+        allocPopulation(&global_bestbox, 1, num_particles); //allocate memory
+
+        if(globalmax.index == 0) //if highest fitness on root
+        {
+            copybox(&global_bestbox, 0, population, highest);
+        }
+        else
+        {
+            if(globalmax.index == rank)
+            {
+                send_boxes(highest, 1, population, 0, 0, MPI_COMM_WORLD);
+            }
+            else if(rank == 0)
+            {
+                recv_boxes(0, 1, &global_bestbox, globalmax.index, 0, MPI_COMM_WORLD);
+            } 
+        }
+
+        double time_spent = 0;
+        if(rank == 0)
+        {
+            double end = MPI_Wtime();
+            time_spent = (double)(end - begin);
+            total_time += time_spent;
+
+            printf("Best fitness found on island %d\n", globalmax.index);
+            printf("# generations = %d\n", gen);
+            printf("Solution:\n");
+            printbox(&global_bestbox, 0);
+            printf("\n");
+
+            if (f == NULL)
+            {
+                printf("Error opening file!\n");
+                exit(1);
+            }
+            
+            printboxFile(&global_bestbox, 0, f);
+            if(cutoff_option > 0)
+                reportCutoffError(&global_bestbox, 0);
+            printf("Time taken: %f\n", time_spent);
+            printf("---------\n");
+            fprintf(results, "%f\n", (double)global_bestbox.fitness[0]);
+            total_fitness += global_bestbox.fitness[0];
+        }
+        freePopulation(&global_bestbox); //release memory
+        long phase_count[NUM_PHASES];
+        double phase_mean[NUM_PHASES], phase_max[NUM_PHASES];
+        reduceTiming(phase_count, phase_mean, phase_max);
+        if(rank == 0)
+            writeTiming(timing, run_name, k, gen, time_spent, phase_count, phase_mean, phase_max);
+        gen_count += gen;
+        eval_count += fitness_evals;
+        hit_count += cache_hits;
+
+        //time per generation of every island, to show how well they are balanced
+        double gen_time = breed_time/gen;
+        double *gen_times = malloc(size*sizeof(double));
+        MPI_Gather(&gen_time, 1, MPI_DOUBLE, gen_times, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+        if(rank == 0)
+            for(int i = 0; i < size; i++)
+                printf("Island %d: %d boxes, %f seconds per generation\n", i, island_sizes[i], gen_times[i]);
+        if(rebalance_option && k + 1 < iter)
+        {   //give every island boxes in proportion to how fast it breeds them
+            if(rank == 0)
+            {
+                double mean_time = 0, max_time = 0; //per generation, as the smoothed speeds predict them
+                for(int i = 0; i < size; i++)
+                {
+                    double speed = island_sizes[i]/fmax(gen_times[i], 1e-9);
+                    island_speeds[i] = island_speeds[i] > 0 ? REBALANCE_SMOOTHING*speed + (1 - REBALANCE_SMOOTHING)*island_speeds[i] : speed;
+                    mean_time += island_sizes[i]/island_speeds[i]/size;
+                    max_time = fmax(max_time, island_sizes[i]/island_speeds[i]);
+                }
+                if(max_time > (1 + REBALANCE_THRESHOLD)*mean_time)
+                    splitPopulation(population_size, size, island_speeds, island_sizes);
+            }
+            MPI_Bcast(island_sizes, size, MPI_INT, 0, MPI_COMM_WORLD);
+            if(island_sizes[rank] != subpopulation_size)
+            {
+                if(steady_state_option)
+                {
+                    freeSteady(subpopulation_size);
+                    initSteady(island_sizes[rank], num_particles);
+                }
+                subpopulation_size = island_sizes[rank];
+                freePopulation(&generations[0]);
+                freePopulation(&generations[1]);
+                allocPopulation(&generations[0], subpopulation_size, num_particles);
+                allocPopulation(&generations[1], subpopulation_size, num_particles);
+                free(chosen);
+                chosen = malloc(subpopulation_size*sizeof(int));
+            }
+            smallest_island = island_sizes[0];
+            for(int i = 1; i < size; i++)
+                smallest_island = island_sizes[i] < smallest_island ? island_sizes[i] : smallest_island;
+            if(smallest_island/10 != exchange_amount)
+            {
+                exchange_amount = smallest_island/10;
+                freePopulation(&emigrants);
+                freePopulation(&immigrants);
+                allocPopulation(&emigrants, exchange_amount, num_particles);
+                allocPopulation(&immigrants, topology.max_links*exchange_amount, num_particles);
+                if(migration_option == MIGRATION_RMA)
+                {   //slots change size too
+                    freeBoard(&board);
+                    initBoard(&board, exchange_amount, num_particles);
+                }
+            }
+        }
+        free(gen_times);
+        if(checkpoint_option > 0)
+        {   //mark the iteration done before its rows go out, a resumed run then starts the next one instead of repeating it
+            (*progress).iteration = k + 1;
+            (*progress).generation = 0; //only the totals, generators and island sizes are restored
+            (*progress).gen_count = gen_count;
+            (*progress).total_fitness = total_fitness;
+            (*progress).total_time = total_time;
+            checkpoint.island = (island_checkpoint){subpopulation_size, highest, island.best, island.best_gen, breed_time, fitness_evals, cache_hits, eval_count, hit_count};
+            saveCheckpoint(population, island_sizes);
+            finishCheckpoint();
+        }
+        if(rank == 0)
+        {
+            fflush(f);
+            fflush(results);
+            fflush(timing);
+            fflush(convergence);
+        }
+    }
+
+    finishCheckpoint();
+    if((checkpoint_option > 0 || resumed) && rank == 0)
+        remove(checkpoint.name); //the run is complete, there is nothing left to resume
+    free(checkpoint.buffer);
+    freePopulation(&generations[0]); //release memory
+    freePopulation(&generations[1]);
+    if(steady_state_option)
+        freeSteady(subpopulation_size);
+    freePopulation(&emigrants);
+    freePopulation(&immigrants);
+    freeTopology(&topology);
+    if(migration_option == MIGRATION_RMA)
+        freeBoard(&board);
+    free(receives);
+    free(sends);
+    free(chosen);
+    free(island_sizes);
+    free(island_speeds);
+    free(lj_table);
+    if(cutoff_option > 0)
+        freeCells();
+    freeCache();
+    free(rng);
+    free(timers);
+
+    long total_evals = 0; //kernel evaluations summed over all islands
+    MPI_Reduce(&eval_count, &total_evals, 1, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    long total_hits = 0;
+    MPI_Reduce(&hit_count, &total_hits, 1, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    if(rank==0)
+    {
+        fprintf(results, "Average fitness: %f\n", (double)total_fitness/(double)k);
+        fprintf(results, "Average generations: %f\n", (double)gen_count/(double)k);
+        fprintf(results, "Average fitness evaluations per generation: %f\n", (double)total_evals/(double)gen_count);
+        fprintf(results, "Fitness cache hit rate: %f\n", (double)total_hits/(double)(total_evals + total_hits));
+        fprintf(results, "Average time spent per iteration: %f\n", (double)total_time/(double)k);
+        fprintf(results, "---------\n");
+        fclose(f);
+        fclose(results);
+        fclose(timing);
+        fclose(convergence);
+    }
+    MPI_Finalize();
+    return 0;
+}
+